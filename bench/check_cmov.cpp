@@ -0,0 +1,108 @@
+// cmov lowering checker: compiles bench/cmov_cases.c with vcc under each -fcmov policy and
+// checks that
+// - the program exits with 0 (otherwise with the number of the first case that came out wrong,
+//   or on a signal where a skipped operand of && or || ran and divided by zero);
+// - the auto and always policies did lower some of it to cmov, so the cases exercise it.
+//
+// cmov_cases.c has selects that are safe to make branch free, and conditions with && and ||
+// whose later operands divide by zero or call a function that does when they are not skipped.
+// It is compiled with -finline-limit=0, so each case sees its arguments as unknown values.
+//
+// usage: check_cmov.exe [--compiler=./compiler.exe] [--work=bench/work]
+//                       [--source=bench/cmov_cases.c]
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+#include <boost/format.hpp>
+
+namespace fs = std::filesystem;
+
+class CheckConfig {
+    public:
+    std::string compiler = "./compiler.exe";
+    std::string work = "bench/work";
+    std::string source = "bench/cmov_cases.c";
+};
+
+// what a program run through std::system did: "exited <code>" or "killed by signal <n>" (which
+// the shell passes on as exit code 128 + n)
+std::string outcome(int status) {
+#ifndef _WIN32
+    if (WIFSIGNALED(status)) {
+        return "killed by signal " + std::to_string(WTERMSIG(status));
+    }
+    int code = WIFEXITED(status)? WEXITSTATUS(status): -1;
+    if (code > 128) {
+        return "killed by signal " + std::to_string(code - 128);
+    }
+    return "exited " + std::to_string(code);
+#else
+    return "exited " + std::to_string(status);
+#endif
+}
+
+std::string quote(std::string path) {
+    return "\"" + path + "\"";
+}
+
+std::string read_file(fs::path path) {
+    std::ifstream file(path);
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+int main(int argc, char* argv[]) {
+    CheckConfig config;
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.find("--compiler=") == 0) config.compiler = value;
+        else if (arg.find("--work=") == 0) config.work = value;
+        else if (arg.find("--source=") == 0) config.source = value;
+        else {
+            std::cerr << "unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    fs::create_directories(config.work);
+    auto work = fs::absolute(config.work);
+    auto compiler = fs::absolute(config.compiler);
+    auto source = fs::absolute(config.source);
+
+    int failed = 0;
+    for (std::string policy: {"auto", "always", "never"}) {
+        // vcc always writes out.s and a.exe to the current directory
+        fs::remove(work / "a.exe");
+        bool built = std::system(("cd " + quote(work.string()) + " && " + quote(compiler.string()) + " " +
+                                  quote(source.string()) + " -finline-limit=0 -fcmov=" + policy).c_str()) == 0 &&
+                     fs::exists(work / "a.exe");
+        if (!built) {
+            std::cout << boost::format("-fcmov=%-7s build failed\n") % policy;
+            failed++;
+            continue;
+        }
+        bool lowered = read_file(work / "out.s").find("    cmov") != std::string::npos;
+        if (policy != "never" && !lowered) {
+            std::cout << boost::format("-fcmov=%-7s made no cmov\n") % policy;
+            failed++;
+        }
+        auto result = outcome(std::system(quote((work / "a.exe").string()).c_str()));
+        if (result != "exited 0") {
+            std::cout << boost::format("-fcmov=%-7s program %s\n") % policy % result;
+            failed++;
+        }
+    }
+
+    std::cout << boost::format("3 policies checked, %d problems\n") % failed;
+    return failed? 1: 0;
+}
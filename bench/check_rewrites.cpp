@@ -0,0 +1,131 @@
+// Algebraic simplifier checker: compiles bench/rewrite_rules.c with vcc and checks that
+// - every rule in rewrite_rules (optimiser.hpp) fired, from the -fopt-stats report;
+// - every call to keep survived into the assembly, i.e. the side-effect guard left
+//   keep(x) * 0, keep(x) - keep(x) and the like alone;
+// - the program exits with 0 (otherwise with the number of the first case that came out wrong).
+//
+// rewrite_rules.c has a function per rule in table order, then truth-only cases and the guarded
+// ones. It is compiled with -finline-limit=0, so each function sees x and y as unknown values,
+// and its expected values follow vcc, whose >> is logical.
+//
+// usage: check_rewrites.exe [--compiler=./compiler.exe] [--work=bench/work]
+//                           [--source=bench/rewrite_rules.c]
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+#include "../optimiser.hpp"
+#include <boost/format.hpp>
+
+namespace fs = std::filesystem;
+
+class CheckConfig {
+    public:
+    std::string compiler = "./compiler.exe";
+    std::string work = "bench/work";
+    std::string source = "bench/rewrite_rules.c";
+};
+
+// exit code of a program run through std::system
+int exit_status(int status) {
+#ifndef _WIN32
+    return WIFEXITED(status)? WEXITSTATUS(status): -1;
+#else
+    return status;
+#endif
+}
+
+std::string quote(std::string path) {
+    return "\"" + path + "\"";
+}
+
+std::string read_file(fs::path path) {
+    std::ifstream file(path);
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+int occurrences(std::string text, std::string part) {
+    int count = 0;
+    for (auto at = text.find(part); at != std::string::npos; at = text.find(part, at + part.size())) {
+        count++;
+    }
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    CheckConfig config;
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.find("--compiler=") == 0) config.compiler = value;
+        else if (arg.find("--work=") == 0) config.work = value;
+        else if (arg.find("--source=") == 0) config.source = value;
+        else {
+            std::cerr << "unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    fs::create_directories(config.work);
+    auto work = fs::absolute(config.work);
+    auto compiler = fs::absolute(config.compiler);
+    auto source = fs::absolute(config.source);
+
+    // vcc always writes out.s and a.exe to the current directory
+    fs::remove(work / "a.exe");
+    bool built = std::system(("cd " + quote(work.string()) + " && " + quote(compiler.string()) + " " +
+                              quote(source.string()) + " -finline-limit=0 -fopt-stats 2> simplify.report").c_str()) == 0 &&
+                 fs::exists(work / "a.exe");
+    if (!built) {
+        std::cout << "build failed\n";
+        return 1;
+    }
+
+    int failed = 0;
+    // the report counts each rule's uses per function on lines like "    simplified x + 0 to x    3"
+    std::set<std::string> fired;
+    std::istringstream report(read_file(work / "simplify.report"));
+    std::regex counter(" *(simplified .*[^ ]) +[0-9]+");
+    std::smatch found;
+    for (std::string line; std::getline(report, line);) {
+        if (std::regex_match(line, found, counter)) {
+            fired.insert(found[1]);
+        }
+    }
+    for (auto& rule: rewrite_rules) {
+        if (!fired.count("simplified " + rule.pattern + " to " + rule.replacement)) {
+            std::cout << boost::format("rule %s => %s%s never fired\n")
+                         % rule.pattern % rule.replacement % (rule.truth_only? " (truth only)": "");
+            failed++;
+        }
+    }
+
+    auto program = read_file(source);
+    int calls = occurrences(program, "keep(") - occurrences(program, "int keep(");
+    int kept = occurrences(read_file(work / "out.s"), "call    _keep\n");
+    if (kept != calls) {
+        std::cout << boost::format("%d of %d calls to keep were dropped\n") % (calls - kept) % calls;
+        failed++;
+    }
+
+    int code = exit_status(std::system(quote((work / "a.exe").string()).c_str()));
+    if (code != 0) {
+        std::cout << boost::format("case %d came out wrong\n") % code;
+        failed++;
+    }
+
+    std::cout << boost::format("%d rules, %d calls to keep checked, %d problems\n")
+                 % rewrite_rules.size() % calls % failed;
+    return failed? 1: 0;
+}
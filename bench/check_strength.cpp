@@ -0,0 +1,233 @@
+// Strength-reduction checker: for each constant in a sweep of divisors and multipliers,
+// compiles a program with vcc that computes x / d, x % d, x /= d and x %= d (or x * m,
+// m * x and x *= m) for edge-case and pseudo-random values of x, and checks the results
+// against C's own /, % and wrapping * computed here.
+//
+// usage: check_strength.exe [--compiler=./compiler.exe] [--work=bench/work]
+//                           [--vcc-flags="..."] [--sweep=N]
+//
+// Each operation sits in a function of its own taking x as a parameter, so the constant is
+// the only literal operand and codegen lowers it through codegen_x86_divide_constant,
+// codegen_x86_modulo_constant or codegen_x86_multiply_constant. The program folds every result
+// into a hash and exits with 0 when that matches the hash computed here.
+
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+#include <boost/format.hpp>
+
+namespace fs = std::filesystem;
+
+class CheckConfig {
+    public:
+    std::string compiler = "./compiler.exe";
+    std::string work = "bench/work";
+    std::string vcc_flags = "-finline-limit=0"; // keeps x a parameter rather than a folded constant
+    int sweep = 20000;                          // pseudo-random values of x per constant
+};
+
+std::vector<int> divisors = {
+    1, -1, 2, -2, 3, -3, 4, 5, -5, 6, 7, -7, 9, 10, 11, 12, 13, 25, 100, -100, 125, 641, 1000,
+    65536, 65537, -65537, 1 << 30, -(1 << 30), 0x55555555, 2147483646, INT_MAX, -INT_MAX, INT_MIN
+};
+
+std::vector<int> multipliers = {
+    0, 1, -1, 2, 3, 4, 5, 7, 8, 9, 10, 15, 16, 17, 24, 31, 33, 40, 45, 63, 65, 100, -3, -8,
+    0x10001, 1 << 30, INT_MAX, INT_MIN
+};
+
+// exit code of a program run through std::system
+int exit_status(int status) {
+#ifndef _WIN32
+    return WIFEXITED(status)? WEXITSTATUS(status): -1;
+#else
+    return status;
+#endif
+}
+
+std::string quote(std::string path) {
+    return "\"" + path + "\"";
+}
+
+// value as a vcc literal (INT_MIN has no literal of its own)
+std::string literal(int value) {
+    return value == INT_MIN? std::string("(~2147483647)"): std::to_string(value);
+}
+
+// the program's hash step, with the wrapping arithmetic vcc generates
+int mix(int h, int v) {
+    return (int) (((uint32_t) h ^ (uint32_t) v) * 16777619u);
+}
+
+int wrap_multiply(int a, int b) {
+    return (int) ((uint32_t) a * (uint32_t) b);
+}
+
+// the values of x each constant is checked with: the ends of int, the neighbourhood of zero
+// and of the constant and its multiples
+std::vector<int> edge_values(int constant) {
+    std::set<long long> wide = {INT_MIN, INT_MIN + 1LL, INT_MIN + 2LL, -2, -1, 0, 1, 2, INT_MAX - 1LL, INT_MAX};
+    for (long long k: {1LL, 2LL, 3LL, 1000LL}) {
+        for (long long delta: {-1LL, 0LL, 1LL}) {
+            wide.insert(k*constant + delta);
+            wide.insert(-k*constant + delta);
+        }
+    }
+    long long top = constant? (INT_MAX/(long long) constant)*constant: 0;
+    for (long long delta: {-1LL, 0LL, 1LL}) {
+        wide.insert(top + delta);
+        wide.insert(-top + delta);
+    }
+    std::vector<int> values;
+    for (auto value: wide) {
+        if (value >= INT_MIN && value <= INT_MAX) {
+            values.push_back((int) value);
+        }
+    }
+    return values;
+}
+
+// text as a count, or -1 if it is not a whole number of at least 0
+int count_value(std::string text) {
+    size_t used = 0;
+    int value = -1;
+    try {
+        value = std::stoi(text, &used);
+    } catch (std::logic_error) {
+        return -1;
+    }
+    return used == text.size()? value: -1;
+}
+
+// the hash the program should arrive at, and its source
+int build_check(int constant, bool divide, int sweep, std::string& source) {
+    std::string c = literal(constant);
+    std::vector<std::string> operations;
+    if (divide) {
+        source = "int q(int x) { return x / " + c + "; }\n"
+                 "int r(int x) { return x % " + c + "; }\n"
+                 "int qa(int x) { x /= " + c + "; return x; }\n"
+                 "int ra(int x) { x %= " + c + "; return x; }\n";
+        operations = {"q", "r", "qa", "ra"};
+    } else {
+        source = "int p(int x) { return x * " + c + "; }\n"
+                 "int pl(int x) { return " + c + " * x; }\n"
+                 "int pa(int x) { x *= " + c + "; return x; }\n";
+        operations = {"p", "pl", "pa"};
+    }
+    source += "int mix(int h, int v) { return (h ^ v) * 16777619; }\n"
+              "int check(int h, int x) {\n";
+    if (divide && constant == -1) {
+        source += "    if (x == (~2147483647)) return h;\n";    // INT_MIN / -1 overflows
+    }
+    for (auto op: operations) {
+        source += "    h = mix(h, " + op + "(x));\n";
+    }
+    source += "    return h;\n}\n"
+              "int main() {\n"
+              "    int h = 0;\n";
+
+    int h = 0;
+    auto check = [&](int x) {
+        if (divide && constant == -1 && x == INT_MIN) {
+            return;
+        }
+        if (divide) {
+            for (int i=0; i<2; i++) {
+                h = mix(h, x / constant);
+                h = mix(h, x % constant);
+            }
+        } else {
+            for (int i=0; i<3; i++) {
+                h = mix(h, wrap_multiply(x, constant));
+            }
+        }
+    };
+    for (auto x: edge_values(constant)) {
+        source += "    h = check(h, " + literal(x) + ");\n";
+        check(x);
+    }
+
+    // a linear congruential sequence spreads the rest over the whole range
+    source += "    int x = 12345;\n"
+              "    for (int i = 0; i < " + std::to_string(sweep) + "; i++) {\n"
+              "        h = check(h, x);\n"
+              "        x = x * 1103515245 + 12345;\n"
+              "    }\n";
+    int x = 12345;
+    for (int i=0; i<sweep; i++) {
+        check(x);
+        x = (int) ((uint32_t) wrap_multiply(x, 1103515245) + 12345u);
+    }
+    source += "    return h != " + literal(h) + ";\n"
+              "}\n";
+    return h;
+}
+
+int main(int argc, char* argv[]) {
+    CheckConfig config;
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.find("--compiler=") == 0) config.compiler = value;
+        else if (arg.find("--work=") == 0) config.work = value;
+        else if (arg.find("--vcc-flags=") == 0) config.vcc_flags = value;
+        else if (arg.find("--sweep=") == 0) config.sweep = count_value(value);
+        else {
+            std::cerr << "unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (config.sweep < 0) {
+        std::cerr << "--sweep must be a whole number\n";
+        return 1;
+    }
+
+    fs::create_directories(config.work);
+    auto work = fs::absolute(config.work);
+    auto compiler = fs::absolute(config.compiler);
+
+    int failed = 0, checked = 0;
+    auto run = [&](int constant, bool divide) {
+        std::string source;
+        int expected = build_check(constant, divide, config.sweep, source);
+        auto path = work / "strength.c";
+        std::ofstream(path) << source;
+
+        // vcc always writes out.s and a.exe to the current directory
+        fs::remove(work / "a.exe");
+        std::string name = (boost::format("%s %d") % (divide? "x / %": "x *") % constant).str();
+        bool built = std::system(("cd " + quote(work.string()) + " && " + quote(compiler.string()) + " " +
+                                  quote(path.string()) + " " + config.vcc_flags).c_str()) == 0 &&
+                     fs::exists(work / "a.exe");
+        int code = built? exit_status(std::system(quote((work / "a.exe").string()).c_str())): -1;
+        checked++;
+        if (!built) {
+            std::cout << boost::format("%-18s build failed\n") % name;
+            failed++;
+        } else if (code != 0) {
+            std::cout << boost::format("%-18s MISMATCH (expected hash %d, program exited %d)\n") % name % expected % code;
+            failed++;
+        }
+    };
+    for (auto d: divisors) {
+        run(d, true);
+    }
+    for (auto m: multipliers) {
+        run(m, false);
+    }
+
+    std::cout << boost::format("%d constants checked, %d failed\n") % checked % failed;
+    return failed? 1: 0;
+}
@@ -0,0 +1,125 @@
+int keep(int x) {
+    return x;
+}
+
+int stop(int x) {
+    return x / (x - x);
+}
+
+int smaller(int a, int b) {
+    int x;
+    if (a < b)
+        x = a;
+    else
+        x = b;
+    return x;
+}
+
+int larger(int a, int b) {
+    return a > b ? a : b;
+}
+
+int at_least(int a, int b) {
+    int x = a;
+    if (x < b)
+        x = b;
+    return x;
+}
+
+int not_less(int a, int b) {
+    return !(a < b) ? 1 : 2;
+}
+
+int guarded_divide(int n) {
+    int s = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        int x;
+        if (i != 0 && 10 / i > 1)
+            x = 1;
+        else
+            x = 2;
+        s = s + x;
+    }
+    return s;
+}
+
+int guarded_select(int n) {
+    int s = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        s = s + (i == 0 || 100 / i > 30 ? 7 : 9);
+    }
+    return s;
+}
+
+int negated_select(int n) {
+    int s = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        s = s + (!(i == 0 || 100 / i > 30) ? 7 : 9);
+    }
+    return s;
+}
+
+int skipped_or(int e) {
+    int x;
+    if (e > 0 || stop(1))
+        x = 3;
+    else
+        x = 4;
+    return x;
+}
+
+int skipped_and(int e) {
+    int x;
+    if (e > 0 && stop(1))
+        x = 3;
+    else
+        x = 4;
+    return x;
+}
+
+int skipped_select(int e) {
+    return e == 0 && stop(1) > 0 ? 5 : 6;
+}
+
+int called_condition(int a) {
+    int x;
+    if (keep(a) > 2)
+        x = 1;
+    else
+        x = 2;
+    return x;
+}
+
+int trapping_condition(int a, int b) {
+    return a / b > 2 ? 1 : 2;
+}
+
+int constant_condition(int a) {
+    return 1 ? a : 2;
+}
+
+int main() {
+    if (smaller(3, 8) != 3) return 1;
+    if (smaller(9, 2) != 2) return 2;
+    if (larger(3, 8) != 8) return 3;
+    if (larger(9, 2) != 9) return 4;
+    if (at_least(3, 8) != 8) return 5;
+    if (at_least(9, 2) != 9) return 6;
+    if (not_less(3, 8) != 2) return 7;
+    if (not_less(9, 2) != 1) return 8;
+    if (guarded_divide(5) != 6) return 9;
+    if (guarded_select(5) != 37) return 10;
+    if (negated_select(5) != 43) return 11;
+    if (skipped_or(1) != 3) return 12;
+    if (skipped_and(0) != 4) return 13;
+    if (skipped_select(1) != 6) return 14;
+    if (called_condition(5) != 1) return 15;
+    if (called_condition(1) != 2) return 16;
+    if (trapping_condition(9, 2) != 1) return 17;
+    if (trapping_condition(9, 4) != 2) return 18;
+    if (constant_condition(4) != 4) return 19;
+    return 0;
+}
@@ -0,0 +1,285 @@
+// Compile-throughput benchmark: generates a synthetic C program in the subset vcc
+// accepts and times lex, parse_program and codegen_x86 on it in-process.
+//
+// usage: compile_bench.exe [--functions=N] [--locals=N] [--depth=N] [--nesting=N]
+//                          [--repeat=N] [--seed=N] [--emit=file.c]
+//
+// Hardware counters (cycles, instructions, branch misses, L1d loads/stores) are
+// collected per phase through perf_event_open where the kernel allows it.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../timing.hpp"
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../codegen.hpp"
+#include "perf_counters.hpp"
+
+class BenchConfig {
+    public:
+    int functions = 10;     // number of generated functions
+    int locals = 6;         // locals declared in each function
+    int depth = 3;          // depth of generated expression trees
+    int nesting = 2;        // depth of nested for loops in each function
+    int repeat = 3;         // timed repetitions
+    int seed = 1;
+    std::string emit = "";  // optionally write the generated source here
+};
+
+class SourceGenerator {
+    public:
+    SourceGenerator(BenchConfig bench_config): config(bench_config), rng(bench_config.seed) {}
+
+    std::string program() {
+        std::string out;
+        for (int f=0; f<config.functions; f++) {
+            out += function(f);
+        }
+        out += "int main() {\n"
+               "    return f" + std::to_string(config.functions - 1) + "(1, 2) & 255;\n"
+               "}\n";
+        return out;
+    }
+
+    private:
+    BenchConfig config;
+    std::mt19937 rng;
+    std::vector<std::string> scope;
+
+    int random(int n) {
+        return std::uniform_int_distribution<int>(0, n - 1)(rng);
+    }
+
+    std::string expression(int depth) {
+        if (depth <= 0 || random(4) == 0) {
+            if (random(3) == 0) {
+                return std::to_string(random(100));
+            }
+            return scope[random(scope.size())];
+        }
+        // division and modulo are left out so the generated programs never trap if run
+        static const std::vector<std::string> ops = {"+", "-", "*", "&", "|", "^", "<", ">=", "==", "!="};
+        return "( " + expression(depth - 1) + " " + ops[random(ops.size())] + " " + expression(depth - 1) + " )";
+    }
+
+    std::string loop_nest(int level, std::string indent) {
+        if (level == config.nesting) {
+            std::string out;
+            for (int i=0; i<config.locals; i++) {
+                out += indent + "v" + std::to_string(i) + " = " + expression(config.depth) + ";\n";
+            }
+            out += indent + "if ( " + expression(config.depth) + " ) {\n" +
+                   indent + "    v0 += 1;\n" +
+                   indent + "} else {\n" +
+                   indent + "    v0 -= 2;\n" +
+                   indent + "}\n";
+            return out;
+        }
+        std::string counter = "i" + std::to_string(level);
+        std::string out = indent + "for ( int " + counter + " = 0; " + counter + " < 4; " + counter + "++ ) {\n";
+        scope.push_back(counter);
+        out += loop_nest(level + 1, indent + "    ");
+        scope.pop_back();
+        out += indent + "}\n";
+        return out;
+    }
+
+    std::string function(int index) {
+        scope = {"a", "b"};
+        std::string out = "int f" + std::to_string(index) + "(int a, int b) {\n";
+        for (int i=0; i<config.locals; i++) {
+            out += "    int v" + std::to_string(i) + " = " + expression(config.depth) + ";\n";
+            scope.push_back("v" + std::to_string(i));
+        }
+        out += loop_nest(0, "    ");
+        if (index > 0) {
+            out += "    return f" + std::to_string(index - 1) + "( v0, " + expression(config.depth) + " );\n";
+        } else {
+            out += "    return " + expression(config.depth) + ";\n";
+        }
+        out += "}\n";
+        return out;
+    }
+};
+
+int count_expression_nodes(std::shared_ptr<Expression> exp) {
+    int count = 1;
+    for_each_child_expression(*exp, [&](std::shared_ptr<Expression> child) {
+        count += count_expression_nodes(child);
+    });
+    return count;
+}
+
+int count_block_item_nodes(std::shared_ptr<BlockItem> item);
+
+int count_statement_nodes(std::shared_ptr<Statement> stat) {
+    if (!stat) {
+        return 0;
+    }
+    int count = 1;
+    for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+        if (exp) {
+            count += count_expression_nodes(exp);
+        }
+    }
+    count += count_statement_nodes(stat->statement1) + count_statement_nodes(stat->statement2);
+    for (auto item: stat->items) {
+        count += count_block_item_nodes(item);
+    }
+    return count;
+}
+
+int count_block_item_nodes(std::shared_ptr<BlockItem> item) {
+    if (item->item_type == "statement") {
+        return 1 + count_statement_nodes(item->statement);
+    }
+    int count = 2;
+    for (auto decl: item->declaration_list->declarations) {
+        count += 1 + (decl->initialised? count_expression_nodes(decl->init_exp): 0);
+    }
+    return count;
+}
+
+int count_program_nodes(Program& prog) {
+    int count = 1;
+    for (auto function: prog.functions) {
+        count++;
+        for (auto item: function->items) {
+            count += count_block_item_nodes(item);
+        }
+    }
+    return count;
+}
+
+class Samples {
+    public:
+    std::vector<double> seconds;
+
+    double mean() {
+        double total = 0;
+        for (auto s: seconds) total += s;
+        return total/seconds.size();
+    }
+
+    double stddev() {
+        double m = mean(), total = 0;
+        for (auto s: seconds) total += (s - m)*(s - m);
+        return seconds.size() > 1? std::sqrt(total/(seconds.size() - 1)): 0.0;
+    }
+
+    double min() {
+        return *std::min_element(seconds.begin(), seconds.end());
+    }
+};
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(std::string phase, Samples samples, double units, std::string unit) {
+    std::cout << boost::format("  %-10s %10.3f ms +- %7.3f (min %10.3f)   %12.0f %s/s\n")
+                 % phase
+                 % (1000*samples.mean())
+                 % (1000*samples.stddev())
+                 % (1000*samples.min())
+                 % (units/samples.mean())
+                 % unit;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.find("--functions=") == 0) config.functions = std::stoi(value);
+        else if (arg.find("--locals=") == 0) config.locals = std::stoi(value);
+        else if (arg.find("--depth=") == 0) config.depth = std::stoi(value);
+        else if (arg.find("--nesting=") == 0) config.nesting = std::stoi(value);
+        else if (arg.find("--repeat=") == 0) config.repeat = std::stoi(value);
+        else if (arg.find("--seed=") == 0) config.seed = std::stoi(value);
+        else if (arg.find("--emit=") == 0) config.emit = value;
+        else {
+            std::cerr << "unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (config.functions < 1 || config.locals < 1 || config.repeat < 1) {
+        std::cerr << "--functions, --locals and --repeat must be at least 1\n";
+        return 1;
+    }
+
+    std::string source = SourceGenerator(config).program();
+    std::string source_path = config.emit != ""? config.emit: "compile_bench_input.c";
+    std::ofstream(source_path) << source;
+
+    Samples lex_samples, parse_samples, codegen_samples, total_samples;
+    size_t token_count = 0, node_count = 0, asm_bytes = 0;
+
+    PerfCounters lex_counters, parse_counters, codegen_counters;
+    CounterSample lex_counts, parse_counts, codegen_counts;
+
+    try {
+        for (int r=0; r<config.repeat; r++) {
+            std::ifstream file(source_path);
+
+            lex_counters.start();
+            auto start = std::chrono::steady_clock::now();
+            auto tokens = lex(file);
+            lex_samples.seconds.push_back(elapsed(start));
+            lex_counters.stop();
+            lex_counts += lex_counters.read_sample();
+            token_count = tokens.size();
+
+            parse_counters.start();
+            start = std::chrono::steady_clock::now();
+            auto prog = parse_program(tokens);
+            parse_samples.seconds.push_back(elapsed(start));
+            parse_counters.stop();
+            parse_counts += parse_counters.read_sample();
+            node_count = count_program_nodes(prog);
+
+            global_functions.clear();   // codegen rejects functions it has already seen
+            codegen_counters.start();
+            start = std::chrono::steady_clock::now();
+            auto assembly = codegen_x86(prog);
+            codegen_samples.seconds.push_back(elapsed(start));
+            codegen_counters.stop();
+            codegen_counts += codegen_counters.read_sample();
+            asm_bytes = assembly.size();
+
+            total_samples.seconds.push_back(lex_samples.seconds.back() +
+                                            parse_samples.seconds.back() +
+                                            codegen_samples.seconds.back());
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error: " << e.what();
+        return 1;
+    }
+    if (config.emit == "") {
+        std::remove(source_path.c_str());
+    }
+
+    std::cout << boost::format("compile_bench: %d functions, %d locals, depth %d, nesting %d, %d repetitions\n")
+                 % config.functions % config.locals % config.depth % config.nesting % config.repeat;
+    std::cout << boost::format("  %d bytes of source, %d tokens, %d AST nodes, %d bytes of asm\n")
+                 % source.size() % token_count % node_count % asm_bytes;
+    report("lex", lex_samples, token_count, "tokens");
+    report("parse", parse_samples, node_count, "nodes");
+    report("codegen", codegen_samples, asm_bytes, "asm bytes");
+    report("total", total_samples, source.size(), "source bytes");
+
+    if (!lex_counts.any_available()) {
+        std::cout << "hardware counters unavailable (" << lex_counters.error << ")\n";
+        return 0;
+    }
+    std::cout << boost::format("\n  %-10s%s\n") % "per run" % format_counter_header();
+    std::cout << boost::format("  %-10s%s\n") % "lex" % format_counters(lex_counts.per(config.repeat));
+    std::cout << boost::format("  %-10s%s\n") % "parse" % format_counters(parse_counts.per(config.repeat));
+    std::cout << boost::format("  %-10s%s\n") % "codegen" % format_counters(codegen_counts.per(config.repeat));
+}
@@ -0,0 +1,25 @@
+int popcount(int x) {
+    int count = 0;
+    while (x != 0) {
+        count += x & 1;
+        x = x >> 1;
+    }
+    return count;
+}
+
+int parity(int x) {
+    x = x ^ (x >> 16);
+    x = x ^ (x >> 8);
+    x = x ^ (x >> 4);
+    x = x ^ (x >> 2);
+    x = x ^ (x >> 1);
+    return x & 1;
+}
+
+int main() {
+    int total = 0;
+    for (int i = 0; i < 4000000; i++) {
+        total += popcount(i) + parity(i);
+    }
+    return total % 256;
+}
@@ -0,0 +1,24 @@
+int collatz_length(int n) {
+    int steps = 0;
+    while (n != 1) {
+        if (n % 2 == 0)
+            n = n / 2;
+        else
+            n = 3 * n + 1;
+        steps++;
+    }
+    return steps;
+}
+
+int main() {
+    int best = 0;
+    int best_n = 0;
+    for (int n = 1; n < 100000; n++) {
+        int length = collatz_length(n);
+        if (length > best) {
+            best = length;
+            best_n = n;
+        }
+    }
+    return best_n % 256;
+}
@@ -0,0 +1,18 @@
+int gcd(int a, int b) {
+    while (b != 0) {
+        int t = b;
+        b = a % b;
+        a = t;
+    }
+    return a;
+}
+
+int main() {
+    int sum = 0;
+    for (int i = 1; i < 1500; i++) {
+        for (int j = 1; j < 1500; j++) {
+            sum += gcd(i, j);
+        }
+    }
+    return sum % 256;
+}
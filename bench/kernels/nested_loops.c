@@ -0,0 +1,11 @@
+int main() {
+    int count = 0;
+    for (int i = 0; i < 600; i++) {
+        for (int j = 0; j < 600; j++) {
+            for (int k = 0; k < 100; k++) {
+                count += (i + j + k) & 3;
+            }
+        }
+    }
+    return count % 256;
+}
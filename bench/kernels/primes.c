@@ -0,0 +1,17 @@
+int is_prime(int n) {
+    if (n < 2)
+        return 0;
+    for (int d = 2; d * d <= n; d++) {
+        if (n % d == 0)
+            return 0;
+    }
+    return 1;
+}
+
+int main() {
+    int count = 0;
+    for (int n = 0; n < 600000; n++) {
+        count += is_prime(n);
+    }
+    return count % 256;
+}
@@ -0,0 +1,180 @@
+#ifndef PERF_COUNTERS
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <boost/format.hpp>
+
+// hardware events collected for each measurement, in CounterSample::values order
+enum CounterEvent {event_cycles, event_instructions, event_branch_misses, event_l1d_loads, event_l1d_stores, counter_event_count};
+
+std::vector<std::string> counter_event_names = {"cycles", "instructions", "branch-misses", "L1d-loads", "L1d-stores"};
+
+class CounterSample {
+    public:
+    double values[counter_event_count] = {0};
+    bool available[counter_event_count] = {false};
+
+    bool any_available() const {
+        for (auto a: available) {
+            if (a) return true;
+        }
+        return false;
+    }
+
+    double ipc() const {
+        if (!available[event_cycles] || !available[event_instructions] || values[event_cycles] == 0) {
+            return 0;
+        }
+        return values[event_instructions]/values[event_cycles];
+    }
+
+    CounterSample& operator+=(const CounterSample& other) {
+        for (int i=0; i<counter_event_count; i++) {
+            values[i] += other.values[i];
+            available[i] = available[i] || other.available[i];
+        }
+        return *this;
+    }
+
+    // the sample averaged over n repetitions
+    CounterSample per(double n) const {
+        CounterSample out = *this;
+        for (auto& value: out.values) {
+            value /= n;
+        }
+        return out;
+    }
+};
+
+// a set of hardware counters attached to this process (pid 0) or to a child process.
+// Counters the kernel or the hardware refuse are left closed and reported as unavailable,
+// so callers can always measure and just print fewer columns.
+class PerfCounters {
+    public:
+    std::string error = "";     // why the first counter failed to open, if it did
+
+    PerfCounters(int pid = 0, bool enable_on_exec = false) {
+        for (int i=0; i<counter_event_count; i++) {
+            fds[i] = -1;
+        }
+#ifdef __linux__
+        const unsigned long long cache_read = PERF_COUNT_HW_CACHE_L1D |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+        const unsigned long long cache_write = PERF_COUNT_HW_CACHE_L1D |
+                                               (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
+                                               (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+        const unsigned int types[counter_event_count] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                         PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+        const unsigned long long configs[counter_event_count] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                                 PERF_COUNT_HW_BRANCH_MISSES, cache_read, cache_write};
+
+        for (int i=0; i<counter_event_count; i++) {
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.inherit = 1;
+            attr.enable_on_exec = enable_on_exec;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds[i] = syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+            if (fds[i] == -1 && error == "") {
+                error = std::string("perf_event_open: ") + std::strerror(errno);
+            }
+        }
+#else
+        error = "hardware counters are only supported on Linux";
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (auto fd: fds) {
+            if (fd != -1) close(fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start() {
+#ifdef __linux__
+        for (auto fd: fds) {
+            if (fd == -1) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for (auto fd: fds) {
+            if (fd != -1) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+
+    // current counts, scaled up if the kernel had to multiplex the counters
+    CounterSample read_sample() {
+        CounterSample sample;
+#ifdef __linux__
+        for (int i=0; i<counter_event_count; i++) {
+            unsigned long long data[3];     // value, time enabled, time running
+            if (fds[i] == -1 || ::read(fds[i], data, sizeof(data)) != sizeof(data)) {
+                continue;
+            }
+            sample.available[i] = true;
+            sample.values[i] = data[2]? (double) data[0]*data[1]/data[2]: 0.0;
+        }
+#endif
+        return sample;
+    }
+
+    private:
+    int fds[counter_event_count];
+};
+
+// one row of counter values, "n/a" for counters that could not be read
+std::string format_counters(const CounterSample& sample) {
+    std::string out;
+    for (int i=0; i<counter_event_count; i++) {
+        if (sample.available[i]) {
+            out += (boost::format(" %14.0f") % sample.values[i]).str();
+        } else {
+            out += (boost::format(" %14s") % "n/a").str();
+        }
+    }
+    if (sample.available[event_cycles] && sample.available[event_instructions]) {
+        out += (boost::format(" %6.2f") % sample.ipc()).str();
+    } else {
+        out += (boost::format(" %6s") % "n/a").str();
+    }
+    return out;
+}
+
+std::string format_counter_header() {
+    std::string out;
+    for (auto name: counter_event_names) {
+        out += (boost::format(" %14s") % name).str();
+    }
+    return out + (boost::format(" %6s") % "IPC").str();
+}
+
+#define PERF_COUNTERS
+#endif
@@ -0,0 +1,267 @@
+int keep(int x) {
+    return x;
+}
+
+int rule1(int x, int y) {
+    return x + 0;
+}
+
+int rule2(int x, int y) {
+    return 0 + x;
+}
+
+int rule3(int x, int y) {
+    return x - 0;
+}
+
+int rule4(int x, int y) {
+    return 0 - x;
+}
+
+int rule5(int x, int y) {
+    return x - x;
+}
+
+int rule6(int x, int y) {
+    return x * 1;
+}
+
+int rule7(int x, int y) {
+    return 1 * x;
+}
+
+int rule8(int x, int y) {
+    return x * 0;
+}
+
+int rule9(int x, int y) {
+    return 0 * x;
+}
+
+int rule10(int x, int y) {
+    return x * -1;
+}
+
+int rule11(int x, int y) {
+    return x / 1;
+}
+
+int rule12(int x, int y) {
+    return x / -1;
+}
+
+int rule13(int x, int y) {
+    return x % 1;
+}
+
+int rule14(int x, int y) {
+    return x << 0;
+}
+
+int rule15(int x, int y) {
+    return x >> 0;
+}
+
+int rule16(int x, int y) {
+    return (x << 12) >> 12;
+}
+
+int rule17(int x, int y) {
+    return x & 0;
+}
+
+int rule18(int x, int y) {
+    return x & -1;
+}
+
+int rule19(int x, int y) {
+    return x & x;
+}
+
+int rule20(int x, int y) {
+    return x | 0;
+}
+
+int rule21(int x, int y) {
+    return x | -1;
+}
+
+int rule22(int x, int y) {
+    return x | x;
+}
+
+int rule23(int x, int y) {
+    return x ^ 0;
+}
+
+int rule24(int x, int y) {
+    return x ^ x;
+}
+
+int rule25(int x, int y) {
+    return x == x;
+}
+
+int rule26(int x, int y) {
+    return x != x;
+}
+
+int rule27(int x, int y) {
+    return x < x;
+}
+
+int rule28(int x, int y) {
+    return x > x;
+}
+
+int rule29(int x, int y) {
+    return x <= x;
+}
+
+int rule30(int x, int y) {
+    return x >= x;
+}
+
+int rule31(int x, int y) {
+    return - -x;
+}
+
+int rule32(int x, int y) {
+    return ~~x;
+}
+
+int rule33(int x, int y) {
+    return !(x == y);
+}
+
+int rule34(int x, int y) {
+    return !(x != y);
+}
+
+int rule35(int x, int y) {
+    return !(x < y);
+}
+
+int rule36(int x, int y) {
+    return !(x > y);
+}
+
+int rule37(int x, int y) {
+    return !(x <= y);
+}
+
+int rule38(int x, int y) {
+    return !(x >= y);
+}
+
+int rule39(int x, int y) {
+    if (!!x) return 1;
+    return 0;
+}
+
+int rule40(int x, int y) {
+    if (x != 0) return 1;
+    return 0;
+}
+
+int rule41(int x, int y) {
+    return !!x;
+}
+
+int truth1(int x, int y) {
+    return !!!x;
+}
+
+int guard1(int x, int y) {
+    return keep(x) * 0;
+}
+
+int guard2(int x, int y) {
+    return 0 * keep(x);
+}
+
+int guard3(int x, int y) {
+    return keep(x) - keep(x);
+}
+
+int guard4(int x, int y) {
+    return keep(x) ^ keep(x);
+}
+
+int guard5(int x, int y) {
+    return keep(x) % 1;
+}
+
+int guard6(int x, int y) {
+    return keep(x) | -1;
+}
+
+int guard7(int x, int y) {
+    return keep(x) == keep(x);
+}
+
+int guard8(int x, int y) {
+    return !!keep(x);
+}
+
+int guard9(int x, int y) {
+    int z = (y = x) * 0;
+    return y + z;
+}
+
+int main() {
+    int x = 1234567;
+    int y = -89;
+    if (rule1(x, y) != 1234567) return 1;
+    if (rule2(x, y) != 1234567) return 2;
+    if (rule3(x, y) != 1234567) return 3;
+    if (rule4(x, y) != -1234567) return 4;
+    if (rule5(x, y) != 0) return 5;
+    if (rule6(x, y) != 1234567) return 6;
+    if (rule7(x, y) != 1234567) return 7;
+    if (rule8(x, y) != 0) return 8;
+    if (rule9(x, y) != 0) return 9;
+    if (rule10(x, y) != -1234567) return 10;
+    if (rule11(x, y) != 1234567) return 11;
+    if (rule12(x, y) != -1234567) return 12;
+    if (rule13(x, y) != 0) return 13;
+    if (rule14(x, y) != 1234567) return 14;
+    if (rule15(x, y) != 1234567) return 15;
+    if (rule16(x, y) != 185991) return 16;
+    if (rule17(x, y) != 0) return 17;
+    if (rule18(x, y) != 1234567) return 18;
+    if (rule19(x, y) != 1234567) return 19;
+    if (rule20(x, y) != 1234567) return 20;
+    if (rule21(x, y) != -1) return 21;
+    if (rule22(x, y) != 1234567) return 22;
+    if (rule23(x, y) != 1234567) return 23;
+    if (rule24(x, y) != 0) return 24;
+    if (rule25(x, y) != 1) return 25;
+    if (rule26(x, y) != 0) return 26;
+    if (rule27(x, y) != 0) return 27;
+    if (rule28(x, y) != 0) return 28;
+    if (rule29(x, y) != 1) return 29;
+    if (rule30(x, y) != 1) return 30;
+    if (rule31(x, y) != 1234567) return 31;
+    if (rule32(x, y) != 1234567) return 32;
+    if (rule33(x, y) != 1) return 33;
+    if (rule34(x, y) != 0) return 34;
+    if (rule35(x, y) != 1) return 35;
+    if (rule36(x, y) != 0) return 36;
+    if (rule37(x, y) != 1) return 37;
+    if (rule38(x, y) != 0) return 38;
+    if (rule39(x, y) != 1) return 39;
+    if (rule40(x, y) != 1) return 40;
+    if (rule41(x, y) != 1) return 41;
+    if (truth1(x, y) != 0) return 42;
+    if (guard1(x, y) != 0) return 43;
+    if (guard2(x, y) != 0) return 44;
+    if (guard3(x, y) != 0) return 45;
+    if (guard4(x, y) != 0) return 46;
+    if (guard5(x, y) != 0) return 47;
+    if (guard6(x, y) != -1) return 48;
+    if (guard7(x, y) != 1) return 49;
+    if (guard8(x, y) != 1) return 50;
+    if (guard9(x, y) != 1234567) return 51;
+    return 0;
+}
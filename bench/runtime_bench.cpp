@@ -0,0 +1,241 @@
+// Runtime benchmark: compiles each kernel in bench/kernels with vcc and with gcc at
+// -O0 and -O2, checks that all three builds exit with the same code and reports
+// their run times and the vcc/gcc ratios.
+//
+// usage: runtime_bench.exe [--compiler=./compiler.exe] [--gcc=gcc] [--kernels=bench/kernels]
+//                          [--work=bench/work] [--repeat=N] [--vcc-flags="..."] [--no-counters]
+//                          [kernel...]
+//
+// On Linux each run is also measured with hardware counters through perf_event_open
+// (falling back to timing only when they are unavailable).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <boost/format.hpp>
+#include "perf_counters.hpp"
+
+namespace fs = std::filesystem;
+
+class RuntimeBenchConfig {
+    public:
+    std::string compiler = "./compiler.exe";
+    std::string gcc = "gcc";
+    std::string kernels = "bench/kernels";
+    std::string work = "bench/work";
+    std::string vcc_flags = "";
+    int repeat = 3;
+    bool counters = true;
+    std::set<std::string> only;     // kernel names to run (all when empty)
+};
+
+class RunResult {
+    public:
+    int exit_code = -1;
+    double best_ms = 0;
+    CounterSample counts;   // hardware counter totals per run
+};
+
+// exit code of a program run through std::system
+int exit_status(int status) {
+#ifndef _WIN32
+    return WIFEXITED(status)? WEXITSTATUS(status): -1;
+#else
+    return status;
+#endif
+}
+
+std::string quote(std::string path) {
+    return "\"" + path + "\"";
+}
+
+bool run_command(std::string command) {
+    return std::system(command.c_str()) == 0;
+}
+
+#ifdef __linux__
+// runs path once with hardware counters attached from its exec onwards
+int run_counted(std::string path, CounterSample& sample, std::string& error) {
+    int go[2];
+    if (pipe(go) != 0) {
+        return -1;
+    }
+    pid_t child = fork();
+    if (child == 0) {
+        // wait until the parent has attached the counters, then become the program
+        char c;
+        close(go[1]);
+        if (read(go[0], &c, 1) != 1) _exit(127);
+        execl(path.c_str(), path.c_str(), (char*) nullptr);
+        _exit(127);
+    }
+    close(go[0]);
+
+    PerfCounters counters(child, true);
+    if (write(go[1], "x", 1) != 1) {
+        close(go[1]);
+        return -1;
+    }
+    close(go[1]);
+
+    int status;
+    waitpid(child, &status, 0);
+    sample = counters.read_sample();
+    error = counters.error;
+    return status;
+}
+#endif
+
+RunResult time_program(std::string path, int repeat, bool counters, std::string& counter_error) {
+    RunResult result;
+    for (int r=0; r<repeat; r++) {
+        auto start = std::chrono::steady_clock::now();
+        int status;
+#ifdef __linux__
+        CounterSample sample;
+        if (counters) {
+            status = run_counted(path, sample, counter_error);
+            result.counts += sample;
+        } else {
+            status = std::system(quote(path).c_str());
+        }
+#else
+        status = std::system(quote(path).c_str());
+#endif
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        result.exit_code = exit_status(status);
+        result.best_ms = r == 0? ms: std::min(result.best_ms, ms);
+    }
+    result.counts = result.counts.per(repeat);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    RuntimeBenchConfig config;
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.find("--compiler=") == 0) config.compiler = value;
+        else if (arg.find("--gcc=") == 0) config.gcc = value;
+        else if (arg.find("--kernels=") == 0) config.kernels = value;
+        else if (arg.find("--work=") == 0) config.work = value;
+        else if (arg.find("--vcc-flags=") == 0) config.vcc_flags = value;
+        else if (arg.find("--repeat=") == 0) config.repeat = std::stoi(value);
+        else if (arg == "--no-counters") config.counters = false;
+        else if (arg.find("--") == 0) {
+            std::cerr << "unknown option: " << arg << "\n";
+            return 1;
+        } else {
+            config.only.insert(arg);
+        }
+    }
+    if (config.repeat < 1) {
+        std::cerr << "--repeat must be at least 1\n";
+        return 1;
+    }
+
+    std::vector<fs::path> kernels;
+    for (auto& entry: fs::directory_iterator(config.kernels)) {
+        auto name = entry.path().stem().string();
+        if (entry.path().extension() == ".c" && (config.only.empty() || config.only.count(name))) {
+            kernels.push_back(fs::absolute(entry.path()));
+        }
+    }
+    std::sort(kernels.begin(), kernels.end());
+
+    fs::create_directories(config.work);
+    auto work = fs::absolute(config.work);
+    auto compiler = fs::absolute(config.compiler);
+
+    std::cout << boost::format("%-14s %5s %11s %11s %11s %8s %8s\n")
+                 % "kernel" % "exit" % "vcc ms" % "gcc-O0 ms" % "gcc-O2 ms" % "vcc/O0" % "vcc/O2";
+
+    bool failed = false;
+    std::string counter_error = "";
+    std::vector<std::pair<std::string, CounterSample>> counter_rows;
+    double log_ratio_o0 = 0, log_ratio_o2 = 0;
+    int measured = 0;
+    for (auto kernel: kernels) {
+        auto name = kernel.stem().string();
+        auto vcc_exe = (work / (name + ".vcc.exe")).string();
+        auto o0_exe = (work / (name + ".gcc-O0.exe")).string();
+        auto o2_exe = (work / (name + ".gcc-O2.exe")).string();
+        fs::remove(work / "a.exe");
+
+        // vcc always writes out.s and a.exe to the current directory
+        bool built = run_command("cd " + quote(work.string()) + " && " + quote(compiler.string()) + " " +
+                                 quote(kernel.string()) + " " + config.vcc_flags) &&
+                     fs::exists(work / "a.exe");
+        if (built) {
+            fs::rename(work / "a.exe", vcc_exe);
+        }
+        built = built &&
+                run_command(config.gcc + " -m32 -O0 -o " + quote(o0_exe) + " " + quote(kernel.string())) &&
+                run_command(config.gcc + " -m32 -O2 -o " + quote(o2_exe) + " " + quote(kernel.string()));
+        if (!built) {
+            std::cout << boost::format("%-14s build failed\n") % name;
+            failed = true;
+            continue;
+        }
+
+        auto vcc = time_program(vcc_exe, config.repeat, config.counters, counter_error);
+        auto o0 = time_program(o0_exe, config.repeat, config.counters, counter_error);
+        auto o2 = time_program(o2_exe, config.repeat, config.counters, counter_error);
+
+        if (vcc.exit_code != o0.exit_code || vcc.exit_code != o2.exit_code) {
+            std::cout << boost::format("%-14s MISMATCH: vcc exited %d, gcc -O0 %d, gcc -O2 %d\n")
+                         % name % vcc.exit_code % o0.exit_code % o2.exit_code;
+            failed = true;
+            continue;
+        }
+
+        std::cout << boost::format("%-14s %5d %11.2f %11.2f %11.2f %8.2f %8.2f\n")
+                     % name % vcc.exit_code % vcc.best_ms % o0.best_ms % o2.best_ms
+                     % (vcc.best_ms/o0.best_ms) % (vcc.best_ms/o2.best_ms);
+        counter_rows.push_back({name + " vcc", vcc.counts});
+        counter_rows.push_back({name + " gcc-O0", o0.counts});
+        counter_rows.push_back({name + " gcc-O2", o2.counts});
+        log_ratio_o0 += std::log(vcc.best_ms/o0.best_ms);
+        log_ratio_o2 += std::log(vcc.best_ms/o2.best_ms);
+        measured++;
+    }
+    if (measured) {
+        std::cout << boost::format("%-14s %5s %11s %11s %11s %8.2f %8.2f\n")
+                     % "geomean" % "" % "" % "" % ""
+                     % std::exp(log_ratio_o0/measured) % std::exp(log_ratio_o2/measured);
+    }
+    std::cout << "(times are the best of " << config.repeat << " runs)\n";
+
+    if (config.counters) {
+        bool available = false;
+        for (auto row: counter_rows) {
+            available = available || row.second.any_available();
+        }
+        if (!available) {
+            std::cout << "\nhardware counters unavailable";
+            if (counter_error != "") {
+                std::cout << " (" << counter_error << ")";
+            }
+            std::cout << "\n";
+        } else {
+            std::cout << boost::format("\n%-22s%s\n") % "per run" % format_counter_header();
+            for (auto row: counter_rows) {
+                std::cout << boost::format("%-22s%s\n") % row.first % format_counters(row.second);
+            }
+        }
+    }
+
+    return failed? 1: 0;
+}
@@ -1,12 +1,24 @@
 #include <fstream>
+#include <regex>
 #include <set>
+#include <sstream>
 #include <string>
+#include <vector>
 
 #include "parser.hpp"
+#include "timing.hpp"
 #include <boost/format.hpp>
 
 int global_counter = 0; // counter for jump labels
 std::map<std::string, std::shared_ptr<Function>> global_functions;
+std::vector<std::pair<int, int>> inline_blocks;     // label counter and stack index of each enclosing inlined call
+std::shared_ptr<Function> current_function;         // the function being generated
+bool omit_frame_pointer = true;     // address locals off esp and drop the ebp frame where possible
+bool peephole = true;               // drop reloads of values just stored
+std::string cmov_policy = "auto";   // conditionals lowered to cmov: "auto" (cheap values), "always" or "never"
+bool strength_reduce = true;        // multiply, divide and modulo by constants without imul and idivl
+bool select_instructions = true;    // immediate, memory and lea operands, flag branches and operand order
+bool rotate_loops = true;           // test while and for conditions at the bottom of the loop
 
 std::map<std::string, std::string> unary_ops = {
     {"-",  "    neg     %eax\n"},
@@ -25,6 +37,54 @@ std::map<std::string, std::string> comparison_ops {
     {"==", "    sete    %al\n"}
 } ;
 
+// conditional jumps taken when a comparison holds, and when it does not
+std::map<std::string, std::string> jump_ops {
+    {">",  "jg "},
+    {"<",  "jl "},
+    {">=", "jge"},
+    {"<=", "jle"},
+    {"!=", "jne"},
+    {"==", "je "}
+};
+
+std::map<std::string, std::string> inverse_jump_ops {
+    {">",  "jle"},
+    {"<",  "jge"},
+    {">=", "jl "},
+    {"<=", "jg "},
+    {"!=", "je "},
+    {"==", "jne"}
+};
+
+// conditional moves taken when a comparison does not hold
+std::map<std::string, std::string> inverse_cmov_ops {
+    {">",  "cmovle"},
+    {"<",  "cmovge"},
+    {">=", "cmovl "},
+    {"<=", "cmovg "},
+    {"!=", "cmove "},
+    {"==", "cmovne"}
+};
+
+// the comparison that holds after swapping its operands
+std::map<std::string, std::string> swapped_comparison_ops {
+    {">",  "<"},
+    {"<",  ">"},
+    {">=", "<="},
+    {"<=", ">="},
+    {"!=", "!="},
+    {"==", "=="}
+};
+
+// read-modify-write forms of the compound assignments, operating directly on the variable
+std::map<std::string, std::string> memory_assignment_ops = {
+    {"+=",  "addl"},
+    {"-=",  "subl"},
+    {"&=",  "andl"},
+    {"^=",  "xorl"},
+    {"|=",  "orl "}
+};
+
 std::map<std::string, std::string> assignment_ops = {
     {"=",   ""},
     {"+=",  "    movl    %d(%%ebp), %%ecx\n"
@@ -35,13 +95,13 @@ std::map<std::string, std::string> assignment_ops = {
     {"*=",  "    movl    %d(%%ebp), %%ecx\n"
             "    imul    %%ecx, %%eax\n"},
     {"/=",  "    movl    %%eax, %%ecx\n"
-            "    movl    $0, %%edx\n"
             "    movl    %d(%%ebp), %%eax\n"
-            "    divl    %%ecx\n"},
+            "    cdq\n"
+            "    idivl   %%ecx\n"},
     {"%=",  "    movl    %%eax, %%ecx\n"
-            "    movl    $0, %%edx\n"
             "    movl    %d(%%ebp), %%eax\n"
-            "    divl    %%ecx\n"
+            "    cdq\n"
+            "    idivl   %%ecx\n"
             "    movl    %%edx, %%eax\n"},
     {"<<=", "    movl    %%eax, %%ecx\n"
             "    movl    %d(%%ebp), %%eax\n"
@@ -75,6 +135,24 @@ std::string codegen_x86_declaration(std::shared_ptr<Declaration> item,
                                     std::set<std::string>& current_scope,
                                     int& stack_index,
                                     int& inner_loop_stack_index);
+// matches a statement (or a block of just one) that is only x = value
+bool codegen_x86_simple_assignment(std::shared_ptr<Statement> stat, std::string& variable, std::shared_ptr<Expression>& value) {
+    if (stat->statement_type == "compound" && stat->items.size() == 1 && stat->items.front()->item_type == "statement") {
+        stat = stat->items.front()->statement;
+    }
+    if (stat->statement_type != "expression" || stat->expression1->exp_type == "null" ||
+        stat->expression1->expressions.size() != 1) {
+        return false;
+    }
+    auto exp = stat->expression1->expressions.front();
+    if (exp->exp_type != "assignment" || exp->assign_type != "=") {
+        return false;
+    }
+    variable = exp->assign_id;
+    value = exp->assign_exp;
+    return true;
+}
+
 std::string codegen_x86_statement(std::shared_ptr<Statement> stat, 
                                   std::map<std::string, int> local_addresses,
                                   std::set<std::string>& current_scope,
@@ -112,10 +190,714 @@ std::string codegen_x86_expression_unary(std::shared_ptr<ExpressionUnary> exp,
 std::string codegen_x86_expression_postfix(std::shared_ptr<ExpressionPostfix> exp,
                                            std::map<std::string, int> local_addresses);
 
+std::string codegen_x86_expression(std::shared_ptr<Expression> exp,
+                                   std::map<std::string, int> local_addresses);
+std::string codegen_x86_discarded_expression(std::shared_ptr<ExpressionComma> exp,
+                                             std::map<std::string, int> local_addresses);
+std::string codegen_x86_branch(std::shared_ptr<Expression> exp,
+                               bool jump_if_true,
+                               std::string label,
+                               std::map<std::string, int> local_addresses);
+std::string codegen_x86_arguments(std::shared_ptr<ExpressionPostfix> exp,
+                                  std::map<std::string, int> local_addresses);
+std::string codegen_x86_select(std::shared_ptr<Expression> condition,
+                               std::shared_ptr<Expression> if_true,
+                               std::shared_ptr<Expression> if_false,
+                               std::map<std::string, int> local_addresses);
+bool codegen_x86_short_circuits(Expression& exp);
+bool codegen_x86_omit_frame_pointer(std::string body, std::string& frameless);
+std::string codegen_x86_peephole(std::string body);
+
+std::string codegen_x86_multiply_constant(int value);
+std::string codegen_x86_divide_constant(int value);
+std::string codegen_x86_modulo_constant(int value);
+
+// log2 of value if it is a power of two (taken as unsigned, so INT_MIN counts), otherwise -1
+int power_of_two(unsigned int value) {
+    if (value == 0 || (value & (value - 1))) {
+        return -1;
+    }
+    int shift = 0;
+    while (value >>= 1) {
+        shift++;
+    }
+    return shift;
+}
+
+// magic multiplier and shift for signed division by a constant (Hacker's Delight, 10-1).
+// d must not be -1, 0 or 1.
+std::pair<int, int> division_magic(int d) {
+    const unsigned int two31 = 0x80000000;
+    unsigned int ad = d < 0? 0u - (unsigned int) d: d;
+    unsigned int t = two31 + ((unsigned int) d >> 31);
+    unsigned int anc = t - 1 - t%ad;            // absolute value of nc
+    int p = 31;
+    unsigned int q1 = two31/anc, r1 = two31 - q1*anc;
+    unsigned int q2 = two31/ad, r2 = two31 - q2*ad;
+    unsigned int delta;
+    do {
+        p++;
+        q1 = 2*q1;
+        r1 = 2*r1;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 = 2*q2;
+        r2 = 2*r2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    int magic = (int) (q2 + 1);
+    if (d < 0) {
+        magic = (int) (0u - (unsigned int) magic);
+    }
+    return {magic, p - 32};
+}
+
+// asm for eax = eax * value using shifts, lea and add/sub where they beat imul
+std::string codegen_x86_multiply_constant(int value) {
+    unsigned int magnitude = value < 0? 0u - (unsigned int) value: value;
+    std::string out;
+
+    if (value == 0) {
+        return "    movl    $0, %eax\n";
+    } else if (value == 1) {
+        return "";
+    } else if (power_of_two(magnitude) != -1) {
+        out = (boost::format("    shll    $%d, %%eax\n") % power_of_two(magnitude)).str();
+    } else if (magnitude == 3 || magnitude == 5 || magnitude == 9) {
+        out = (boost::format("    leal    (%%eax,%%eax,%d), %%eax\n") % (magnitude - 1)).str();
+    } else if ((magnitude % 3 == 0 && power_of_two(magnitude/3) != -1) ||
+               (magnitude % 5 == 0 && power_of_two(magnitude/5) != -1) ||
+               (magnitude % 9 == 0 && power_of_two(magnitude/9) != -1)) {
+        int factor = power_of_two(magnitude/3) != -1? 3: power_of_two(magnitude/5) != -1? 5: 9;
+        out = (boost::format("    leal    (%%eax,%%eax,%d), %%eax\n"
+                             "    shll    $%d, %%eax\n") % (factor - 1) % power_of_two(magnitude/factor)).str();
+    } else if (power_of_two(magnitude - 1) != -1) {
+        out = (boost::format("    movl    %%eax, %%ecx\n"
+                             "    shll    $%d, %%eax\n"
+                             "    addl    %%ecx, %%eax\n") % power_of_two(magnitude - 1)).str();
+    } else if (power_of_two(magnitude + 1) != -1) {
+        out = (boost::format("    movl    %%eax, %%ecx\n"
+                             "    shll    $%d, %%eax\n"
+                             "    subl    %%ecx, %%eax\n") % power_of_two(magnitude + 1)).str();
+    } else {
+        return (boost::format("    imull   $%d, %%eax, %%eax\n") % value).str();
+    }
+    if (value < 0) {
+        out += "    neg     %eax\n";
+    }
+    return out;
+}
+
+// asm for eax = eax / value (signed, truncating towards zero), clobbers ecx and edx
+std::string codegen_x86_divide_constant(int value) {
+    unsigned int magnitude = value < 0? 0u - (unsigned int) value: value;
+    int shift = power_of_two(magnitude);
+    std::string out;
+
+    if (value == 1) {
+        return "";
+    } else if (value == -1) {
+        return "    neg     %eax\n";
+    } else if (shift != -1) {
+        // bias negative dividends by 2^shift - 1 so the arithmetic shift rounds towards zero
+        boost::format format_str(shift == 1?
+            "    movl    %%eax, %%edx\n"
+            "    shrl    $31, %%edx\n"
+            "    addl    %%edx, %%eax\n"
+            "    sarl    $1, %%eax\n":
+            "    movl    %%eax, %%edx\n"
+            "    sarl    $31, %%edx\n"
+            "    shrl    $%d, %%edx\n"
+            "    addl    %%edx, %%eax\n"
+            "    sarl    $%d, %%eax\n");
+        if (shift != 1) {
+            format_str % (32 - shift) % shift;
+        }
+        out = format_str.str();
+        if (value < 0) {
+            out += "    neg     %eax\n";
+        }
+        return out;
+    }
+
+    auto magic = division_magic(value);
+    out = (boost::format("    movl    %%eax, %%ecx\n"           // keep the dividend in ecx
+                         "    movl    $%d, %%edx\n"
+                         "    imull   %%edx\n")                 // edx = high half of dividend * magic
+           % magic.first).str();
+    if (value > 0 && magic.first < 0) {
+        out += "    addl    %ecx, %edx\n";
+    } else if (value < 0 && magic.first > 0) {
+        out += "    subl    %ecx, %edx\n";
+    }
+    if (magic.second > 0) {
+        out += (boost::format("    sarl    $%d, %%edx\n") % magic.second).str();
+    }
+    out += "    movl    %edx, %eax\n"
+           "    shrl    $31, %eax\n"                            // add one to negative quotients
+           "    addl    %edx, %eax\n";
+    return out;
+}
+
+// asm for eax = eax % value (sign follows the dividend), clobbers ecx and edx
+std::string codegen_x86_modulo_constant(int value) {
+    unsigned int magnitude = value < 0? 0u - (unsigned int) value: value;
+    int shift = power_of_two(magnitude);
+
+    if (magnitude == 1) {
+        return "    movl    $0, %eax\n";
+    } else if (shift != -1) {
+        // n - ((n + bias) & -2^shift), with the same bias as division
+        boost::format format_str("    movl    %%eax, %%ecx\n"
+                                 "    movl    %%eax, %%edx\n"
+                                 "    sarl    $31, %%edx\n"
+                                 "    shrl    $%d, %%edx\n"
+                                 "    addl    %%edx, %%eax\n"
+                                 "    andl    $%d, %%eax\n"
+                                 "    subl    %%eax, %%ecx\n"
+                                 "    movl    %%ecx, %%eax\n");
+        format_str % (32 - shift) % (int) (0u - magnitude);
+        return format_str.str();
+    }
+    // n - (n / value) * value, the division sequence leaves n in ecx
+    return codegen_x86_divide_constant(value) +
+           (boost::format("    imull   $%d, %%eax, %%eax\n"
+                          "    subl    %%eax, %%ecx\n"
+                          "    movl    %%ecx, %%eax\n") % value).str();
+}
+
+// the instruction operand for exp if it is an integer literal ($n) or a variable (n(%ebp)),
+// which instructions can use in place instead of having it loaded into eax first
+bool codegen_x86_operand(std::shared_ptr<Expression> exp,
+                         std::map<std::string, int>& local_addresses,
+                         std::string& operand) {
+    int value;
+    if (!select_instructions) {
+        return false;
+    }
+    if (constant_value(*exp, value)) {
+        operand = "$" + std::to_string(value);
+        return true;
+    }
+    auto inner = innermost_expression(exp);
+    if (inner->exp_class == ExpClass::postfix) {
+        auto& exp_post = dynamic_cast<ExpressionPostfix&>(*inner);
+        if (exp_post.exp_type == "variable" && local_addresses.count(exp_post.id)) {
+            operand = std::to_string(local_addresses[exp_post.id]) + "(%ebp)";
+            return true;
+        }
+    }
+    return false;
+}
+
+// matches variable*scale (or scale*variable) with a scale lea can apply to an index register
+bool codegen_x86_scaled_index(std::shared_ptr<Expression> exp,
+                              std::map<std::string, int>& local_addresses,
+                              std::string& index,
+                              int& scale) {
+    auto inner = innermost_expression(exp);
+    if (inner->exp_class != ExpClass::mult) {
+        return false;
+    }
+    auto& exp_mult = dynamic_cast<ExpressionMult&>(*inner);
+    if (exp_mult.expressions.size() != 2 || exp_mult.operators.front() != "*") {
+        return false;
+    }
+    for (auto order: {0, 1}) {
+        auto variable = order? exp_mult.expressions.back(): exp_mult.expressions.front();
+        auto factor = order? exp_mult.expressions.front(): exp_mult.expressions.back();
+        if (constant_value(*factor, scale) && (scale == 2 || scale == 4 || scale == 8) &&
+            codegen_x86_operand(variable, local_addresses, index) && index[0] != '$') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether exp is a literal or a variable, which the lowering uses in place without evaluating it
+bool codegen_x86_is_leaf(std::shared_ptr<Expression> exp) {
+    int value;
+    auto inner = innermost_expression(exp);
+    return constant_value(*inner, value) ||
+           (inner->exp_class == ExpClass::postfix &&
+            dynamic_cast<ExpressionPostfix&>(*inner).exp_type == "variable");
+}
+
+// Sethi-Ullman number for the stack-based lowering: the most temporaries evaluating exp keeps
+// pushed at once. Every operand after the first that is not a leaf holds the running value on
+// the stack while it is computed.
+int codegen_x86_stack_need(std::shared_ptr<Expression> exp) {
+    if (codegen_x86_is_leaf(exp)) {
+        return 0;
+    }
+    auto inner = innermost_expression(exp);
+    if (inner->exp_class == ExpClass::postfix &&
+        dynamic_cast<ExpressionPostfix&>(*inner).exp_type == "function_call") {
+        // arguments are pushed right to left, each evaluated above the ones before it
+        auto& exp_call = dynamic_cast<ExpressionPostfix&>(*inner);
+        int need = 0, pushed = 0;
+        for (auto arg = exp_call.args.rbegin(); arg != exp_call.args.rend(); arg++) {
+            need = std::max(need, pushed + codegen_x86_stack_need(*arg));
+            pushed++;
+        }
+        return std::max(need, pushed);
+    }
+    int need = 0;
+    bool first = true;
+    for_each_child_expression(*inner, [&](std::shared_ptr<Expression> child) {
+        if (first) {
+            need = codegen_x86_stack_need(child);
+        } else if (!codegen_x86_is_leaf(child)) {
+            need = std::max(need, 1 + codegen_x86_stack_need(child));
+        }
+        first = false;
+    });
+    return need;
+}
+
+// evaluation order for the operands of a chain of commutative operators. Operands that have to
+// be computed go first, the one needing the most temporaries leading (Sethi-Ullman), so that the
+// ones usable in place (literals, variables and lea-able scaled indices) follow without pushing
+// the running value. Source order is kept when any operand assigns to a variable.
+std::vector<int> codegen_x86_operand_order(std::vector<std::shared_ptr<Expression>> operands,
+                                           std::map<std::string, int>& local_addresses) {
+    std::vector<int> order, in_place;
+    std::string operand, index;
+    int scale;
+    for (int i=0; i<operands.size(); i++) {
+        if (!select_instructions || writes_variables(*operands[i])) {
+            order.clear();
+            for (int j=0; j<operands.size(); j++) {
+                order.push_back(j);
+            }
+            return order;
+        }
+        if (codegen_x86_operand(operands[i], local_addresses, operand) ||
+            codegen_x86_scaled_index(operands[i], local_addresses, index, scale)) {
+            in_place.push_back(i);
+        } else {
+            order.push_back(i);
+        }
+    }
+    std::vector<int> need;
+    for (auto operand_exp: operands) {
+        need.push_back(codegen_x86_stack_need(operand_exp));
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return need[a] > need[b];
+    });
+    order.insert(order.end(), in_place.begin(), in_place.end());
+    return order;
+}
+
+// asm for any expression node, dispatching on its class
+std::string codegen_x86_expression(std::shared_ptr<Expression> exp, std::map<std::string, int> local_addresses) {
+    switch (exp->exp_class) {
+        case ExpClass::comma:
+            return codegen_x86_expression_comma(std::static_pointer_cast<ExpressionComma>(exp), local_addresses);
+        case ExpClass::assignment:
+            return codegen_x86_expression_assignment(std::static_pointer_cast<ExpressionAssignment>(exp), local_addresses);
+        case ExpClass::conditional:
+            return codegen_x86_expression_conditional(std::static_pointer_cast<ExpressionConditional>(exp), local_addresses);
+        case ExpClass::logicor:
+            return codegen_x86_expression_logic_or(std::static_pointer_cast<ExpressionLogicOr>(exp), local_addresses);
+        case ExpClass::logicand:
+            return codegen_x86_expression_logic_and(std::static_pointer_cast<ExpressionLogicAnd>(exp), local_addresses);
+        case ExpClass::bitwiseor:
+            return codegen_x86_expression_bitwise_or(std::static_pointer_cast<ExpressionBitwiseOr>(exp), local_addresses);
+        case ExpClass::bitwisexor:
+            return codegen_x86_expression_bitwise_xor(std::static_pointer_cast<ExpressionBitwiseXor>(exp), local_addresses);
+        case ExpClass::bitwiseand:
+            return codegen_x86_expression_bitwise_and(std::static_pointer_cast<ExpressionBitwiseAnd>(exp), local_addresses);
+        case ExpClass::equality:
+            return codegen_x86_expression_equality(std::static_pointer_cast<ExpressionEquality>(exp), local_addresses);
+        case ExpClass::relational:
+            return codegen_x86_expression_relational(std::static_pointer_cast<ExpressionRelational>(exp), local_addresses);
+        case ExpClass::shift:
+            return codegen_x86_expression_shift(std::static_pointer_cast<ExpressionShift>(exp), local_addresses);
+        case ExpClass::add:
+            return codegen_x86_expression_add(std::static_pointer_cast<ExpressionAdd>(exp), local_addresses);
+        case ExpClass::mult:
+            return codegen_x86_expression_mult(std::static_pointer_cast<ExpressionMult>(exp), local_addresses);
+        case ExpClass::unary:
+            return codegen_x86_expression_unary(std::static_pointer_cast<ExpressionUnary>(exp), local_addresses);
+        default: // case ExpClass::postfix:
+            return codegen_x86_expression_postfix(std::static_pointer_cast<ExpressionPostfix>(exp), local_addresses);
+    }
+}
+
+// asm for an assignment, increment or decrement whose value is not used: a single
+// read-modify-write instruction on the variable where there is one
+std::string codegen_x86_discarded_assignment(std::shared_ptr<ExpressionAssignment> exp, std::map<std::string, int> local_addresses) {
+    auto inner = innermost_expression(exp);
+    std::string operand;
+    int value;
+
+    if (inner->exp_class == ExpClass::unary || inner->exp_class == ExpClass::postfix) {
+        std::string id, op;
+        if (inner->exp_class == ExpClass::unary) {
+            auto& exp_unary = dynamic_cast<ExpressionUnary&>(*inner);
+            if (exp_unary.exp_type == "prefix") {
+                id = exp_unary.prefix_id;
+                op = exp_unary.unaryop;
+            }
+        } else {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(*inner);
+            if (exp_post.exp_type == "postfix") {
+                id = exp_post.id;
+                op = exp_post.postfix_op;
+            }
+        }
+        if (id != "" && local_addresses.count(id)) {
+            boost::format out_format("    %s    %d(%%ebp)\n");
+            out_format % (op == "++"? "incl": "decl") % local_addresses[id];
+            return out_format.str();
+        }
+    } else if (inner->exp_class == ExpClass::assignment) {
+        auto exp_assign = std::static_pointer_cast<ExpressionAssignment>(inner);
+        if (exp_assign->exp_type == "assignment" && local_addresses.count(exp_assign->assign_id)) {
+            int address = local_addresses[exp_assign->assign_id];
+            std::string type = exp_assign->assign_type;
+            std::shared_ptr<Expression> rhs = exp_assign->assign_exp;
+
+            // x = x op y is x op= y
+            auto rhs_inner = innermost_expression(rhs);
+            std::shared_ptr<Expression> first, second;
+            std::string rhs_op;
+            if (rhs_inner->exp_class == ExpClass::add) {
+                auto& exp_add = dynamic_cast<ExpressionAdd&>(*rhs_inner);
+                if (exp_add.expressions.size() == 2) {
+                    first = exp_add.expressions.front();
+                    second = exp_add.expressions.back();
+                    rhs_op = exp_add.operators.front();
+                }
+            } else if (rhs_inner->exp_class == ExpClass::bitwiseand ||
+                       rhs_inner->exp_class == ExpClass::bitwisexor ||
+                       rhs_inner->exp_class == ExpClass::bitwiseor) {
+                std::vector<std::shared_ptr<Expression>> children;
+                for_each_child_expression(*rhs_inner, [&](std::shared_ptr<Expression> child) {
+                    children.push_back(child);
+                });
+                if (children.size() == 2) {
+                    first = children[0];
+                    second = children[1];
+                    rhs_op = rhs_inner->exp_class == ExpClass::bitwiseand? "&":
+                             rhs_inner->exp_class == ExpClass::bitwisexor? "^": "|";
+                }
+            }
+            if (type == "=" && first && codegen_x86_operand(first, local_addresses, operand) &&
+                operand == std::to_string(address) + "(%ebp)") {
+                type = rhs_op + "=";
+                rhs = second;
+            }
+
+            if (type == "=" && constant_value(*rhs, value)) {
+                boost::format out_format("    movl    $%d, %d(%%ebp)\n");
+                out_format % value % address;
+                return out_format.str();
+            } else if ((type == "+=" || type == "-=") && constant_value(*rhs, value) && (value == 1 || value == -1)) {
+                boost::format out_format("    %s    %d(%%ebp)\n");
+                out_format % ((type == "+=") == (value == 1)? "incl": "decl") % address;
+                return out_format.str();
+            } else if (memory_assignment_ops.count(type)) {
+                if (constant_value(*rhs, value)) {
+                    boost::format out_format("    %s    $%d, %d(%%ebp)\n");
+                    out_format % memory_assignment_ops[type] % value % address;
+                    return out_format.str();
+                }
+                boost::format out_format(
+                    "%s"                                        // asm for the right hand side (stored in eax)
+                    "    %s    %%eax, %d(%%ebp)\n"              // operate on the variable in memory
+                );
+                out_format % codegen_x86_expression(rhs, local_addresses) % memory_assignment_ops[type] % address;
+                return out_format.str();
+            } else if ((type == "<<=" || type == ">>=") && constant_value(*rhs, value)) {
+                boost::format out_format("    %s    $%d, %d(%%ebp)\n");
+                out_format % (type == "<<="? "shll": "shrl") % (value & 31) % address;
+                return out_format.str();
+            }
+        }
+    }
+    return codegen_x86_expression_assignment(exp, local_addresses);
+}
+
+// asm for a comma expression evaluated only for its side effects
+std::string codegen_x86_discarded_expression(std::shared_ptr<ExpressionComma> exp, std::map<std::string, int> local_addresses) {
+    if (!select_instructions) {
+        return codegen_x86_expression_comma(exp, local_addresses);
+    }
+    std::string out = "";
+    if (exp->exp_type == "assignment") {
+        for (auto expression: exp->expressions) {
+            out += codegen_x86_discarded_assignment(expression, local_addresses);
+        }
+    }
+    return out;
+}
+
+// asm that sets the flags for left op right. The operands are swapped (and op with them) when
+// that lets a literal or variable be compared in place or evaluates the operand needing more
+// temporaries first, as long as neither assigns to a variable.
+std::string codegen_x86_compare(std::shared_ptr<Expression> left,
+                                std::string& op,
+                                std::shared_ptr<Expression> right,
+                                std::map<std::string, int> local_addresses) {
+    std::string operand;
+    int value;
+    bool left_leaf = codegen_x86_is_leaf(left), right_leaf = codegen_x86_is_leaf(right);
+    if (select_instructions && !writes_variables(*left) && !writes_variables(*right) &&
+        ((left_leaf && !right_leaf) ||
+         (left_leaf && right_leaf && constant_value(*left, value) && !constant_value(*right, value)) ||
+         (!left_leaf && !right_leaf && codegen_x86_stack_need(right) > codegen_x86_stack_need(left)))) {
+        std::swap(left, right);
+        op = swapped_comparison_ops[op];
+    }
+
+    if (constant_value(*right, value) && codegen_x86_operand(left, local_addresses, operand) && operand[0] != '$') {
+        return "    cmpl    $" + std::to_string(value) + ", " + operand + "\n";     // compare the variable in memory
+    } else if (codegen_x86_operand(right, local_addresses, operand)) {
+        return codegen_x86_expression(left, local_addresses) +              // asm for first operand (stored in eax)
+               "    cmpl    " + operand + ", %eax\n";                        // compare first operand to second operand
+    }
+    boost::format out_format("%s"                                           // asm for first operand (stored in eax)
+                             "    pushl   %%eax\n"                          // push first operand to stack
+                             "%s"                                           // asm for second operand (stored in eax)
+                             "    pop     %%ecx\n"                          // pop first operand to ecx
+                             "    cmpl    %%eax, %%ecx\n");                 // compare first operand to second operand
+    out_format % codegen_x86_expression(left, local_addresses) % codegen_x86_expression(right, local_addresses);
+    return out_format.str();
+}
+
+// asm that jumps to label when exp is true (jump_if_true) or false, and falls through otherwise.
+// && and || short-circuit, also under a !. When selecting instructions, comparisons also jump on
+// the flags of a single cmpl and a constant condition becomes an unconditional jump or nothing.
+std::string codegen_x86_branch(std::shared_ptr<Expression> exp,
+                               bool jump_if_true,
+                               std::string label,
+                               std::map<std::string, int> local_addresses) {
+    auto inner = innermost_expression(exp);
+    std::string operand;
+    int value;
+
+    if (select_instructions && constant_value(*inner, value)) {
+        return (value != 0) == jump_if_true? "    jmp     " + label + "\n": std::string("");
+    }
+
+    std::shared_ptr<Expression> left, right;
+    std::string op;
+    if (select_instructions && inner->exp_class == ExpClass::relational) {
+        auto& exp_rel = dynamic_cast<ExpressionRelational&>(*inner);
+        if (exp_rel.expressions.size() == 2) {
+            left = exp_rel.expressions.front();
+            right = exp_rel.expressions.back();
+            op = exp_rel.operators.front();
+        }
+    } else if (select_instructions && inner->exp_class == ExpClass::equality) {
+        auto& exp_eq = dynamic_cast<ExpressionEquality&>(*inner);
+        if (exp_eq.expressions.size() == 2) {
+            left = exp_eq.expressions.front();
+            right = exp_eq.expressions.back();
+            op = exp_eq.operators.front();
+        }
+    }
+    if (left) {
+        std::string out = codegen_x86_compare(left, op, right, local_addresses);
+        boost::format jump_format("    %s     %s\n");
+        jump_format % (jump_if_true? jump_ops[op]: inverse_jump_ops[op]) % label;
+        return out + jump_format.str();
+    }
+
+    if (inner->exp_class == ExpClass::unary) {
+        auto exp_unary = std::static_pointer_cast<ExpressionUnary>(inner);
+        if (exp_unary->exp_type == "unary_op" && exp_unary->unaryop == "!" &&
+            (select_instructions || codegen_x86_short_circuits(*exp_unary->unary_exp))) {
+            return codegen_x86_branch(exp_unary->unary_exp, !jump_if_true, label, local_addresses);
+        }
+    }
+
+    if (inner->exp_class == ExpClass::logicand || inner->exp_class == ExpClass::logicor) {
+        std::vector<std::shared_ptr<Expression>> operands;
+        for_each_child_expression(*inner, [&](std::shared_ptr<Expression> child) {
+            operands.push_back(child);
+        });
+        // a && b is false as soon as one operand is false, a || b is true as soon as one is true
+        bool decided_by = inner->exp_class == ExpClass::logicor;
+        std::string out = "";
+        if (jump_if_true == decided_by) {
+            for (auto operand_exp: operands) {
+                out += codegen_x86_branch(operand_exp, jump_if_true, label, local_addresses);
+            }
+            return out;
+        }
+        int local_counter = global_counter;
+        global_counter++;
+        std::string skip_label = "_sc" + std::to_string(local_counter);
+        for (int i=0; i<operands.size()-1; i++) {
+            out += codegen_x86_branch(operands[i], decided_by, skip_label, local_addresses);
+        }
+        out += codegen_x86_branch(operands.back(), jump_if_true, label, local_addresses);
+        return out + skip_label + ":\n";
+    }
+
+    std::string out;
+    if (codegen_x86_operand(inner, local_addresses, operand)) {
+        out = "    cmpl    $0, " + operand + "\n";                           // test the variable in memory
+    } else {
+        out = codegen_x86_expression(inner, local_addresses) +              // asm for condition (stored in eax)
+              "    cmpl    $0, %eax\n";
+    }
+    return out + (jump_if_true? "    jne     ": "    je      ") + label + "\n";
+}
+
+// whether exp can be computed when its value might not be needed: it assigns nothing, calls
+// nothing and cannot trap. operations counts the nodes that do work.
+bool codegen_x86_can_speculate(Expression& exp, int& operations) {
+    if (writes_variables(exp)) {
+        return false;
+    }
+    if (exp.exp_class == ExpClass::postfix && dynamic_cast<ExpressionPostfix&>(exp).exp_type == "function_call") {
+        return false;
+    } else if (exp.exp_class == ExpClass::mult) {
+        auto& exp_mult = dynamic_cast<ExpressionMult&>(exp);
+        auto divisor = exp_mult.expressions.begin();
+        for (auto op: exp_mult.operators) {
+            divisor++;
+            int value;
+            if (op != "*" && (!constant_value(**divisor, value) || value == 0 || value == -1)) {
+                return false;
+            }
+        }
+    }
+    int children = 0;
+    bool safe = true;
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        safe = safe && codegen_x86_can_speculate(*child, operations);
+        children++;
+    });
+    int value;
+    if (children && !singleton_child(exp) && !constant_value(exp, value)) {
+        operations++;
+    }
+    return safe;
+}
+
+// whether exp has an && or || of more than one operand, whose later operands only a branch
+// skips (computed for its value, codegen_x86_expression runs them all)
+bool codegen_x86_short_circuits(Expression& exp) {
+    if ((exp.exp_class == ExpClass::logicand || exp.exp_class == ExpClass::logicor) && !singleton_child(exp)) {
+        return true;
+    }
+    bool found = false;
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        found = found || codegen_x86_short_circuits(*child);
+    });
+    return found;
+}
+
+// whether condition? if_true: if_false should become a cmov: the condition has to be computable
+// for its value alone (no && or || to skip operands of, nothing to call or trap on) and both values
+// safe to compute regardless of it, and under the "auto" policy cheap enough (a couple of
+// operations each) that computing the one not needed costs less than a mispredicted branch
+bool codegen_x86_use_cmov(std::shared_ptr<Expression> condition,
+                          std::shared_ptr<Expression> if_true,
+                          std::shared_ptr<Expression> if_false) {
+    int condition_operations = 0;
+    if (cmov_policy == "never" || codegen_x86_short_circuits(*condition) ||
+        !codegen_x86_can_speculate(*condition, condition_operations)) {
+        return false;
+    }
+    int true_operations = 0, false_operations = 0;
+    if (!codegen_x86_can_speculate(*if_true, true_operations) ||
+        !codegen_x86_can_speculate(*if_false, false_operations)) {
+        return false;
+    }
+    return cmov_policy == "always" || (true_operations <= 2 && false_operations <= 2);
+}
+
+// asm that leaves condition? if_true: if_false in eax without branching: both values are
+// computed (those that are not literals or variables onto the stack), then the condition sets
+// the flags and a cmov replaces if_true with if_false when it does not hold
+std::string codegen_x86_select(std::shared_ptr<Expression> condition,
+                               std::shared_ptr<Expression> if_true,
+                               std::shared_ptr<Expression> if_false,
+                               std::map<std::string, int> local_addresses) {
+    auto inner = innermost_expression(condition);
+    while (inner->exp_class == ExpClass::unary &&
+           dynamic_cast<ExpressionUnary&>(*inner).exp_type == "unary_op" &&
+           dynamic_cast<ExpressionUnary&>(*inner).unaryop == "!") {
+        // !c? a: b is c? b: a
+        inner = innermost_expression(dynamic_cast<ExpressionUnary&>(*inner).unary_exp);
+        std::swap(if_true, if_false);
+    }
+
+    std::string out = "";
+    std::string true_operand, false_operand;
+    bool true_in_place = codegen_x86_operand(if_true, local_addresses, true_operand);
+    bool false_in_place = codegen_x86_operand(if_false, local_addresses, false_operand);
+    if (!true_in_place) {
+        out += codegen_x86_expression(if_true, local_addresses) +          // asm for the true value
+               "    pushl   %eax\n";
+    }
+    if (!false_in_place) {
+        out += codegen_x86_expression(if_false, local_addresses) +         // asm for the false value
+               "    pushl   %eax\n";
+    }
+
+    std::shared_ptr<Expression> left, right;
+    std::string op = "!=";
+    if (inner->exp_class == ExpClass::relational || inner->exp_class == ExpClass::equality) {
+        std::vector<std::shared_ptr<Expression>> operands;
+        for_each_child_expression(*inner, [&](std::shared_ptr<Expression> child) {
+            operands.push_back(child);
+        });
+        if (operands.size() == 2) {
+            left = operands.front();
+            right = operands.back();
+            op = inner->exp_class == ExpClass::relational?
+                 dynamic_cast<ExpressionRelational&>(*inner).operators.front():
+                 dynamic_cast<ExpressionEquality&>(*inner).operators.front();
+        }
+    }
+    std::string operand;
+    if (left) {
+        out += codegen_x86_compare(left, op, right, local_addresses);
+    } else if (codegen_x86_operand(inner, local_addresses, operand) && operand[0] != '$') {
+        out += "    cmpl    $0, " + operand + "\n";                          // test the variable in memory
+    } else {
+        out += codegen_x86_expression(inner, local_addresses) +             // asm for condition (stored in eax)
+               "    cmpl    $0, %eax\n";
+    }
+
+    // mov and pop leave the flags alone
+    if (!false_in_place) {
+        out += "    pop     %ecx\n";
+        false_operand = "%ecx";
+    } else if (false_operand[0] == '$') {
+        out += "    movl    " + false_operand + ", %ecx\n";                  // cmov takes no immediates
+        false_operand = "%ecx";
+    }
+    if (!true_in_place) {
+        out += "    pop     %eax\n";
+    } else {
+        out += "    movl    " + true_operand + ", %eax\n";
+    }
+    boost::format cmov_format("    %-7s %s, %%eax\n");
+    cmov_format % inverse_cmov_ops[op] % false_operand;
+    return out + cmov_format.str();
+}
+
 std::string codegen_x86(Program prog) {
     std::string out;
 
     for (auto function : prog.functions) {
+        TraceScope trace("codegen " + function->id, "codegen");
         out += codegen_x86_function(function);
     }
 
@@ -149,6 +931,7 @@ std::string codegen_x86_function(std::shared_ptr<Function> function) {
     if (!function->defined) {
         return std::string("");
     }
+    current_function = function;
 
     if (function->params.size()) {
         // iterating forwards over the arguments allows us to 
@@ -163,22 +946,175 @@ std::string codegen_x86_function(std::shared_ptr<Function> function) {
     boost::format out_format(
         ".globl _%s\n_"
         "%s:\n"
-        "    pushl   %%ebp\n"
-        "    movl    %%esp, %%ebp\n"
     );
     out_format % function->id % function->id;
     std::string out = out_format.str();
+    std::string body = "";
+    if (function->tail_recursive) {
+        body += "_" + function->id + ".tail:\n";           // target of self tail calls, past the prologue
+    }
     for (auto item : function->items) {
-        out += codegen_x86_block_item(item, locals, current_scope, stack_index, inner_loop_stack_index, inner_loop_count);
+        body += codegen_x86_block_item(item, locals, current_scope, stack_index, inner_loop_stack_index, inner_loop_count);
+    }
+    if (function->falls_off_end) {
+        body += "    movl    $0, %eax\n"
+                "    movl    %ebp, %esp\n"          // add function epilogue (ensures all function return eventually)
+                "    pop     %ebp\n"
+                "    ret\n";
+    }
+
+    if (peephole) {
+        body = codegen_x86_peephole(body);
     }
-    out += "    movl    $0, %eax\n"
-           "    movl    %ebp, %esp\n"               // add function epilogue (ensures all function return eventually)
-           "    pop     %ebp\n"
-           "    ret\n";
+    std::string frameless;
+    if (omit_frame_pointer && codegen_x86_omit_frame_pointer(body, frameless)) {
+        return out + frameless;
+    }
+    return out + "    pushl   %ebp\n"
+                 "    movl    %esp, %ebp\n" + body;
+}
 
+// Store-to-load forwarding on the generated instructions. Each statement leaves its value in
+// eax, so one that ends by storing it is often followed by one starting with a load of the same
+// variable:
+//     movl    %eax, -4(%ebp)           movl    %eax, -4(%ebp)
+//     movl    -4(%ebp), %eax     =>    (dropped)
+//     pushl   -4(%ebp)                 pushl   %eax
+// Only adjacent instructions are paired, so no label (and no other path in) comes between them.
+// A jmp to the label right after it (left by the last return of an inlined body) goes too.
+std::string codegen_x86_peephole(std::string body) {
+    static const std::string store = "    movl    %eax, ";
+    static const std::string jmp = "    jmp     ";
+    std::string out = "";
+    std::string stored = "";        // the memory operand the last instruction stored eax to
+    std::vector<std::string> lines;
+    std::istringstream in(body);
+    for (std::string line; std::getline(in, line);) {
+        lines.push_back(line);
+    }
+    for (size_t i=0; i<lines.size(); i++) {
+        auto line = lines[i];
+        if (line.find(jmp) == 0 && i + 1 < lines.size() && lines[i + 1] == line.substr(jmp.size()) + ":") {
+            continue;               // falls through to it anyway
+        } else if (stored != "" && line == "    movl    " + stored + ", %eax") {
+            continue;               // eax already holds it
+        } else if (stored != "" && line == "    pushl   " + stored) {
+            line = "    pushl   %eax";
+        }
+        stored = line.find(store) == 0 && line.find("(%ebp)") != std::string::npos? line.substr(store.size()): "";
+        out += line + "\n";
+    }
     return out;
 }
 
+// Rewrites a function body generated against an ebp frame to address its parameters and locals
+// off esp, so it needs no prologue and returns with at most an addl. Every instruction that
+// moves esp is a push, a pop, an addl/subl of a constant or an epilogue, so the number of bytes
+// pushed since entry is known at each instruction: it carries on from the instruction before,
+// or after a jump or return comes from the jumps to the next label. Code no jump reaches is
+// dropped. Returns false, leaving the frame in place, when the paths into a label disagree or
+// some instruction uses esp or ebp in any other way.
+bool codegen_x86_omit_frame_pointer(std::string body, std::string& frameless) {
+    static const std::regex ebp_operand("(-?\\d+)\\(%ebp\\)");
+    static const std::regex esp_constant("    (addl|subl)    \\$(\\d+), %esp");
+    static const std::regex jump("    j\\w+ +(\\S+)");
+
+    std::vector<std::string> lines;
+    std::istringstream in(body);
+    for (std::string line; std::getline(in, line);) {
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+
+    std::map<std::string, int> label_depths;
+    auto sweep = [&]() {
+        frameless = "";
+        int depth = 0;          // bytes pushed since entry, or -1 where no path reaches
+        for (int i=0; i<lines.size(); i++) {
+            std::string line = lines[i];
+            std::smatch match;
+            if (line.back() == ':') {
+                std::string label = line.substr(0, line.size() - 1);
+                if (depth == -1 && label_depths.count(label)) {
+                    depth = label_depths[label];
+                } else if (depth != -1 && label_depths.count(label) && label_depths[label] != depth) {
+                    return false;
+                }
+                if (depth != -1) {
+                    label_depths[label] = depth;
+                    frameless += line + "\n";
+                }
+                continue;
+            } else if (depth == -1) {
+                continue;
+            }
+
+            if (line == "    movl    %ebp, %esp") {
+                // an epilogue: "pop %ebp; ret" or "pop %ebp; jmp _f" returns or tail calls,
+                // "jmp _f.tail" restarts the function
+                if (depth) {
+                    frameless += "    addl    $" + std::to_string(depth) + ", %esp\n";
+                }
+                depth = 0;
+                if (i + 1 < lines.size() && lines[i + 1] == "    pop     %ebp") {
+                    i++;
+                }
+                continue;
+            }
+            if (line.find("%esp") != std::string::npos) {
+                if (!std::regex_search(line, match, esp_constant)) {
+                    return false;
+                }
+                depth += (match[1] == "subl"? 1: -1)*std::stoi(match[2]);
+            } else if (line.find("    pop") == 0) {
+                depth -= 4;             // a pop addresses its operand with esp already moved
+            }
+
+            std::string rewritten = "";
+            auto rest = line;
+            while (std::regex_search(rest, match, ebp_operand)) {
+                int offset = std::stoi(match[1]);
+                // parameters sit above the return address, locals below it
+                offset = (offset > 0? offset - 4: offset) + depth;
+                rewritten += match.prefix().str() + std::to_string(offset) + "(%esp)";
+                rest = match.suffix().str();
+            }
+            rewritten += rest;
+            if (rewritten.find("%ebp") != std::string::npos) {
+                return false;
+            }
+            frameless += rewritten + "\n";
+
+            if (line.find("    push") == 0) {
+                depth += 4;             // a push addresses its operand before esp moves
+            } else if (std::regex_search(line, match, jump) && match.position(0) == 0) {
+                std::string target = match[1];
+                if (label_depths.count(target) && label_depths[target] != depth) {
+                    return false;
+                }
+                label_depths[target] = depth;
+                if (line.find("    jmp") == 0) {
+                    depth = -1;
+                }
+            } else if (line == "    ret") {
+                depth = -1;
+            }
+        }
+        return true;
+    };
+
+    // labels reached only by jumps from further down are found by sweeping again
+    int known;
+    do {
+        known = label_depths.size();
+        if (!sweep()) {
+            return false;
+        }
+    } while (label_depths.size() != known);
+    return true;
+}
+
 std::string codegen_x86_block_item(std::shared_ptr<BlockItem> item, 
                                    std::map<std::string, int>& local_addresses, 
                                    std::set<std::string>& current_scope, 
@@ -220,7 +1156,10 @@ std::string codegen_x86_declaration(std::shared_ptr<Declaration> decl,
     current_scope.insert(decl->var_id);
     stack_index -= 4;
 
-    if (decl->initialised) {
+    std::string operand;
+    if (decl->initialised && codegen_x86_operand(decl->init_exp, local_addresses, operand)) {
+        return "    pushl   " + operand + "\n";                     // push the literal or variable straight onto the stack
+    } else if (decl->initialised) {
         boost::format format_str(
             "%s"                         // asm for variable value (stored in eax)
             "    pushl   %%eax\n"        // push variable onto stack
@@ -239,12 +1178,36 @@ std::string codegen_x86_statement(std::shared_ptr<Statement> stat,
                                   int& inner_loop_stack_index,
                                   int inner_loop_count) {
     if (stat->statement_type == "expression") {
-        return codegen_x86_expression_comma(stat->expression1, local_addresses);
+        return codegen_x86_discarded_expression(stat->expression1, local_addresses);
     } else if (stat->statement_type == "conditional") {
-        std::string out = codegen_x86_expression_comma(
-            stat->expression1, local_addresses);           // asm for condition (stored in eax)
-        boost::format out_format("    cmpl    $0, %%eax\n"      // test value of condition
-                                 "    je      _e%d\n"           // if condition is 0, jump to else code
+        // if (c) x = a; [else x = b;] stores c? a: b (or c? a: x) to x, through a cmov when
+        // codegen_x86_use_cmov allows it
+        std::string variable;
+        std::shared_ptr<Expression> if_true, if_false;
+        if (codegen_x86_simple_assignment(stat->statement1, variable, if_true) &&
+            local_addresses.count(variable)) {
+            std::string else_variable;
+            auto else_exp = stat->statement2->statement_type == "expression"? stat->statement2->expression1: nullptr;
+            if (else_exp && else_exp->exp_type == "null") {
+                auto current = std::shared_ptr<ExpressionPostfix>(new ExpressionPostfix);
+                current->exp_class = ExpClass::postfix;
+                current->exp_type = "variable";
+                current->id = variable;
+                if_false = current;
+            } else if (!codegen_x86_simple_assignment(stat->statement2, else_variable, if_false) ||
+                       else_variable != variable) {
+                if_false = nullptr;
+            }
+            if (if_false && codegen_x86_use_cmov(stat->expression1, if_true, if_false)) {
+                boost::format out_format("%s"                       // asm for the selected value
+                                         "    movl    %%eax, %d(%%ebp)\n");
+                out_format % codegen_x86_select(stat->expression1, if_true, if_false, local_addresses)
+                           % local_addresses[variable];
+                return out_format.str();
+            }
+        }
+
+        boost::format out_format("%s"                           // asm to jump to else code if the condition is 0
                                  "%s"                           // asm for if code
                                  "    jmp     _end%d\n"         // jump past else code
                                  "_e%d:\n"                      // label for else code
@@ -253,15 +1216,14 @@ std::string codegen_x86_statement(std::shared_ptr<Statement> stat,
         
         int local_counter = global_counter;
         global_counter++;
-        out_format % local_counter
+        out_format % codegen_x86_branch(stat->expression1, false, "_e" + std::to_string(local_counter), local_addresses)
                    % codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count)
                    % local_counter
                    % local_counter
                    % codegen_x86_statement(stat->statement2, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count)
                    % local_counter;
 
-        out += out_format.str();
-        return out;
+        return out_format.str();
     } else if (stat->statement_type.find("for") == 0) {
         std::string out = "";
         std::set<std::string> current_scope;
@@ -277,30 +1239,49 @@ std::string codegen_x86_statement(std::shared_ptr<Statement> stat,
                                          inner_loop_stack_index,
                                          inner_loop_count);                 // asm for init declaration
         } else { // if (stat->statement_type == "for_expression") {
-            out = codegen_x86_expression_comma(
+            out = codegen_x86_discarded_expression(
                 stat->expression1, local_addresses);                   // asm for init expression
         }
         int inner_loop_stack_index = stack_index; // save stack position of the loop body scope for continue and break statements
-        boost::format out_format("_cond%d:\n"                               // label for loop condition
-                                 "%s"                                       // asm for condition expression (stored in eax)
-                                 "    cmpl    $0, %%eax\n"                  // compare condition to 0
-                                 "    je      _end%d\n"                     // if the condition is false, jump to the end of the loop
-                                 "%s"                                       // asm for loop body statement
-                                 "_cont%d:\n"                               // label for continue statement
-                                 "%s"                                       // asm for post expression
-                                 "    jmp    _cond%d\n"                     // jump to loop condition
-                                 "_end%d:\n"                                // label for end of loop
-                                );
-        out_format % local_counter
-                   % codegen_x86_expression_comma(stat->expression2, local_addresses)
-                   % local_counter
-                   % codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count)
-                   % local_counter
-                   % codegen_x86_expression_comma(stat->expression3, local_addresses)
-                   % local_counter
-                   % local_counter;
-
-        out += out_format.str();
+        std::string end_label = "_end" + std::to_string(local_counter);
+        std::string start_label = "_start" + std::to_string(local_counter);
+        if (rotate_loops) {
+            // rotated: the condition is tested once on entry and then at the bottom of each
+            // iteration, so every iteration but the last takes a single backward branch
+            boost::format out_format("%s"                                   // asm to skip the loop if the condition is false on entry
+                                     "_start%d:\n"                          // label for loop start
+                                     "%s"                                   // asm for loop body statement
+                                     "_cont%d:\n"                           // label for continue statement
+                                     "%s"                                   // asm for post expression
+                                     "%s"                                   // asm to jump back to the start if the condition is true
+                                     "_end%d:\n"                            // label for end of loop
+                                    );
+            out_format % codegen_x86_branch(stat->expression2, false, end_label, local_addresses)
+                       % local_counter
+                       % codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count)
+                       % local_counter
+                       % codegen_x86_discarded_expression(stat->expression3, local_addresses)
+                       % codegen_x86_branch(stat->expression2, true, start_label, local_addresses)
+                       % local_counter;
+            out += out_format.str();
+        } else {
+            boost::format out_format("_cond%d:\n"                           // label for loop condition
+                                     "%s"                                   // asm to jump to the end of the loop if the condition is false
+                                     "%s"                                   // asm for loop body statement
+                                     "_cont%d:\n"                           // label for continue statement
+                                     "%s"                                   // asm for post expression
+                                     "    jmp     _cond%d\n"                // jump to loop condition
+                                     "_end%d:\n"                            // label for end of loop
+                                    );
+            out_format % local_counter
+                       % codegen_x86_branch(stat->expression2, false, end_label, local_addresses)
+                       % codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count)
+                       % local_counter
+                       % codegen_x86_discarded_expression(stat->expression3, local_addresses)
+                       % local_counter
+                       % local_counter;
+            out += out_format.str();
+        }
 
         if (stat->statement_type == "for_declaration") {
             boost::format dealloc("    addl    $%d, %%esp\n");              // deallocate variables from header scope
@@ -315,48 +1296,58 @@ std::string codegen_x86_statement(std::shared_ptr<Statement> stat,
         int inner_loop_count = global_counter;
         global_counter++;
         int inner_loop_stack_index = stack_index; // save stack position of the loop body scope for continue and break statements
-        
-        std::string cond = codegen_x86_expression_comma(stat->expression1, local_addresses);
-        std::string body = codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count);
 
-        std::string out_format = "";
-        boost::format loop_format;
-
-        if (stat->statement_type == "while") {
-            out_format = "_cond%d:\n"                                       // label for loop condition
-                         "%s"                                               // asm for condition expression (stored in eax)
-                         "    cmpl    $0, %%eax\n"                          // compare condition to 0
-                         "    je      _end%d\n"                             // if condition is false, jump to end of loop
-                         "%s"                                               // asm for loop body statement
-                         "_cont%d:\n"                                       // label for continue statement
-                         "    jmp     _cond%d\n"                            // jump to condition
-                         "_end%d:\n";                                       // label for end of loop
-            loop_format = boost::format(out_format);
+        if (!rotate_loops && stat->statement_type == "while") {
+            std::string cond = codegen_x86_branch(stat->expression1, false, "_end" + std::to_string(local_counter), local_addresses);
+            std::string body = codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count);
+            boost::format loop_format("_cond%d:\n"                          // label for loop condition
+                                      "%s"                                  // asm to jump to the end of the loop if the condition is false
+                                      "%s"                                  // asm for loop body statement
+                                      "_cont%d:\n"                          // label for continue statement
+                                      "    jmp     _cond%d\n"               // jump to condition
+                                      "_end%d:\n");                         // label for end of loop
             loop_format % local_counter
                         % cond
-                        % local_counter
                         % body
                         % local_counter
                         % local_counter
                         % local_counter;
-        } else { // if (stat->statement_type == "do") {
-            out_format = "_start%d:\n"                                      // label for loop start
-                         "%s"                                               // asm for loop body statement
-                         "%s"                                               // asm for condition expression (stored in eax)
-                         "    cmpl    $0, %%eax\n"                          // compare condition to 0
-                         "    je      _end%d\n"                             // if condition is false, jump to end of loop
-                         "_cont%d:\n"                                       // label for continue statement
-                         "    jmp     _start%d\n"                           // jump to start of loop
-                         "_end%d:\n";                                       // label for end of loop
-            loop_format = boost::format(out_format);
+            return loop_format.str();
+        } else if (!rotate_loops) {
+            std::string body = codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count);
+            boost::format loop_format("_start%d:\n"                         // label for loop start
+                                      "%s"                                  // asm for loop body statement
+                                      "_cont%d:\n"                          // label for continue statement
+                                      "%s"                                  // asm to jump to the end of the loop if the condition is false
+                                      "    jmp     _start%d\n"              // jump to start of loop
+                                      "_end%d:\n");                         // label for end of loop
             loop_format % local_counter
                         % body
-                        % cond
-                        % local_counter
                         % local_counter
+                        % codegen_x86_branch(stat->expression1, false, "_end" + std::to_string(local_counter), local_addresses)
                         % local_counter
                         % local_counter;
+            return loop_format.str();
         }
+
+        std::string body = codegen_x86_statement(stat->statement1, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count);
+        std::string loop_cond = codegen_x86_branch(stat->expression1, true, "_start" + std::to_string(local_counter), local_addresses);
+
+        // both loops test their condition at the bottom, a while loop also once on entry
+        boost::format loop_format("%s"                                      // asm to skip a while loop if the condition is false on entry
+                                  "_start%d:\n"                             // label for loop start
+                                  "%s"                                      // asm for loop body statement
+                                  "_cont%d:\n"                              // label for continue statement
+                                  "%s"                                      // asm to jump back to the start if the condition is true
+                                  "_end%d:\n");                             // label for end of loop
+        loop_format % (stat->statement_type == "while"?
+                           codegen_x86_branch(stat->expression1, false, "_end" + std::to_string(local_counter), local_addresses):
+                           std::string(""))
+                    % local_counter
+                    % body
+                    % local_counter
+                    % loop_cond
+                    % local_counter;
         out += loop_format.str();
         return out;
     } else if (stat->statement_type == "break") {
@@ -403,6 +1394,64 @@ std::string codegen_x86_statement(std::shared_ptr<Statement> stat,
             out += out_format.str();
         }
         return out;
+    } else if (stat->statement_type == "inline") {
+        // the body of a call inlined by the optimiser, left early by its inline_return statements
+        std::string out = "";
+        std::set<std::string> current_scope;
+        int local_counter = global_counter;
+        global_counter++;
+
+        inline_blocks.push_back({local_counter, stack_index});
+        for (auto item: stat->items) {
+            out += codegen_x86_block_item(item, local_addresses, current_scope, stack_index, inner_loop_stack_index, inner_loop_count);
+        }
+        inline_blocks.pop_back();
+        if (current_scope.size()) {
+            boost::format out_format("    addl    $%d, %%esp\n");               // deallocate variables from the inner scope
+            out_format % (4*current_scope.size());
+            out += out_format.str();
+        }
+        boost::format out_format("_ret%d:\n");                                  // label for inline_return statements
+        out_format % local_counter;
+        return out + out_format.str();
+    } else if (stat->statement_type == "inline_return") {
+        int inline_stack_index = inline_blocks.back().second;
+        boost::format out_format;
+        if (inline_stack_index - stack_index > 0) {
+            out_format = boost::format("%s"                                     // asm to store the return value
+                                       "    addl    $%d, %%esp\n"               // deallocate the inlined body's variables
+                                       "    jmp     _ret%d\n");
+            out_format % codegen_x86_discarded_expression(stat->expression1, local_addresses)
+                       % (inline_stack_index - stack_index)
+                       % inline_blocks.back().first;
+        } else {
+            out_format = boost::format("%s"                                     // asm to store the return value
+                                       "    jmp     _ret%d\n");
+            out_format % codegen_x86_discarded_expression(stat->expression1, local_addresses)
+                       % inline_blocks.back().first;
+        }
+        return out_format.str();
+    } else if (stat->statement_type == "tail_call") {
+        // return f(...) in this function's frame: the arguments are all evaluated before any of
+        // them overwrites one of this function's own, which f then finds where it expects them
+        auto call = std::static_pointer_cast<ExpressionPostfix>(innermost_expression(stat->expression1));
+        std::string out = codegen_x86_arguments(call, local_addresses);
+        for (int i=0; i<call->args.size(); i++) {
+            boost::format pop_format("    popl    %d(%%ebp)\n");              // overwrite a parameter
+            pop_format % (8 + 4*i);
+            out += pop_format.str();
+        }
+        boost::format out_format;
+        if (call->id == current_function->id) {
+            out_format = boost::format("    movl    %%ebp, %%esp\n"          // deallocate every local
+                                       "    jmp     _%s.tail\n");             // start the function again
+        } else {
+            out_format = boost::format("    movl    %%ebp, %%esp\n"
+                                       "    pop     %%ebp\n"
+                                       "    jmp     _%s\n");                  // f returns straight to our caller
+        }
+        out_format % call->id;
+        return out + out_format.str();
     } else { // if (stat->statement_type == "return") {
         boost::format out_format("%s"
                                  "    movl    %%ebp, %%esp\n"
@@ -433,6 +1482,23 @@ std::string codegen_x86_expression_assignment(std::shared_ptr<ExpressionAssignme
         if (!local_addresses.count(exp->assign_id)) {
             throw std::runtime_error("variable '" + exp->assign_id + "' used before declaration\n");
         }
+        int value;
+        auto type = exp->assign_type;
+        if (strength_reduce && (type == "*=" || type == "/=" || type == "%=") &&
+            constant_value(*exp->assign_exp, value) && (type == "*=" || value != 0)) {
+            boost::format format_str(
+                "    movl    %d(%%ebp), %%eax\n"                // load the variable
+                "%s"                                            // asm for the operation by a constant
+                "    movl    %%eax, %d(%%ebp)\n"                // store the result
+            );
+            format_str % local_addresses[exp->assign_id]
+                       % (type == "*="? codegen_x86_multiply_constant(value):
+                          type == "/="? codegen_x86_divide_constant(value):
+                                        codegen_x86_modulo_constant(value))
+                       % local_addresses[exp->assign_id];
+            return format_str.str();
+        }
+
         boost::format format_str(
             "%s"                                                // asm for variable value (stored in eax)
             "%s"                                                // asm for assignment operation
@@ -455,10 +1521,10 @@ std::string codegen_x86_expression_conditional(std::shared_ptr<ExpressionConditi
     if (exp->exp_type == "logic_or") {
         return codegen_x86_expression_logic_or(exp->condition, local_addresses);
     } else { // if (exp->exp_type == "conditional") {
-        std::string out = codegen_x86_expression_logic_or(
-            exp->condition, local_addresses);                   // asm for condition (stored in eax)
-        boost::format format_str("    cmpl    $0, %%eax\n"      // check value of condition
-                                 "    je      _e%d\n"           // if the condition is 0, jump to else code
+        if (codegen_x86_use_cmov(exp->condition, exp->exp_true, exp->exp_false)) {
+            return codegen_x86_select(exp->condition, exp->exp_true, exp->exp_false, local_addresses);
+        }
+        boost::format format_str("%s"                           // asm to jump to else code if the condition is 0
                                  "%s"                           // asm for if code
                                  "    jmp     _end%d\n"         // jump past else code
                                  "_e%d:\n"                      // label for else code
@@ -467,15 +1533,14 @@ std::string codegen_x86_expression_conditional(std::shared_ptr<ExpressionConditi
 
         int local_counter = global_counter;
         global_counter++;
-        format_str % local_counter
+        format_str % codegen_x86_branch(exp->condition, false, "_e" + std::to_string(local_counter), local_addresses)
                    % codegen_x86_expression_comma(exp->exp_true, local_addresses)
                    % local_counter
                    % local_counter
                    % codegen_x86_expression_conditional(exp->exp_false, local_addresses)
                    % local_counter;
 
-        out += format_str.str();
-        return out;
+        return format_str.str();
     }
 }
 
@@ -536,20 +1601,25 @@ std::string codegen_x86_expression_bitwise_or(std::shared_ptr<ExpressionBitwiseO
     if (exp->expressions.size() == 1) {
         return codegen_x86_expression_bitwise_xor(exp->expressions.front(), local_addresses);
     } else {
-        std::string out = codegen_x86_expression_bitwise_xor(
-            exp->expressions.front(), local_addresses);             // asm for first operand (stored in eax)
+        std::vector<std::shared_ptr<Expression>> operands(exp->expressions.begin(), exp->expressions.end());
+        auto order = codegen_x86_operand_order(operands, local_addresses);
+
+        std::string out = codegen_x86_expression(
+            operands[order[0]], local_addresses);                   // asm for first operand (stored in eax)
         std::string xor_format_str = "    pushl   %%eax\n"          // push first operand to stack
                                      "%s"                           // asm for second operand (stored in eax)
                                      "    pop     %%ecx\n"          // pop first operand to ecx
                                      "    orl     %%ecx, %%eax\n";  // calculate first operand | second operand and store in eax
 
-        auto expression = exp->expressions.begin();
-        std::advance(expression, 1);
-        for (int i=0; i<exp->expressions.size()-1; i++) {
-            boost::format format_str(xor_format_str);
-            format_str % codegen_x86_expression_bitwise_xor(*expression, local_addresses);
-            out += format_str.str();
-            std::advance(expression, 1);
+        for (int i=1; i<order.size(); i++) {
+            std::string operand;
+            if (codegen_x86_operand(operands[order[i]], local_addresses, operand)) {
+                out += "    orl     " + operand + ", %eax\n";         // operate on the literal or variable in place
+            } else {
+                boost::format format_str(xor_format_str);
+                format_str % codegen_x86_expression(operands[order[i]], local_addresses);
+                out += format_str.str();
+            }
         }
         return out;
     }
@@ -559,20 +1629,25 @@ std::string codegen_x86_expression_bitwise_xor(std::shared_ptr<ExpressionBitwise
     if (exp->expressions.size() == 1) {
         return codegen_x86_expression_bitwise_and(exp->expressions.front(), local_addresses);
     } else {
-        std::string out = codegen_x86_expression_bitwise_and(
-            exp->expressions.front(), local_addresses);             // asm for first operand (stored in eax)
+        std::vector<std::shared_ptr<Expression>> operands(exp->expressions.begin(), exp->expressions.end());
+        auto order = codegen_x86_operand_order(operands, local_addresses);
+
+        std::string out = codegen_x86_expression(
+            operands[order[0]], local_addresses);                   // asm for first operand (stored in eax)
         std::string xor_format_str = "    pushl   %%eax\n"          // push first operand to stack
                                      "%s"                           // asm for second operand (stored in eax)
                                      "    pop     %%ecx\n"          // pop first operand to ecx
                                      "    xorl    %%ecx, %%eax\n";  // calculate first operand ^ second operand and store in eax
 
-        auto expression = exp->expressions.begin();
-        std::advance(expression, 1);
-        for (int i=0; i<exp->expressions.size()-1; i++) {
-            boost::format format_str(xor_format_str);
-            format_str % codegen_x86_expression_bitwise_and(*expression, local_addresses);
-            out += format_str.str();
-            std::advance(expression, 1);
+        for (int i=1; i<order.size(); i++) {
+            std::string operand;
+            if (codegen_x86_operand(operands[order[i]], local_addresses, operand)) {
+                out += "    xorl    " + operand + ", %eax\n";         // operate on the literal or variable in place
+            } else {
+                boost::format format_str(xor_format_str);
+                format_str % codegen_x86_expression(operands[order[i]], local_addresses);
+                out += format_str.str();
+            }
         }
         return out;
     }
@@ -582,20 +1657,25 @@ std::string codegen_x86_expression_bitwise_and(std::shared_ptr<ExpressionBitwise
     if (exp->expressions.size() == 1) {
         return codegen_x86_expression_equality(exp->expressions.front(), local_addresses);
     } else {
-        std::string out = codegen_x86_expression_equality(
-            exp->expressions.front(), local_addresses);             // asm for first operand (stored in eax)
+        std::vector<std::shared_ptr<Expression>> operands(exp->expressions.begin(), exp->expressions.end());
+        auto order = codegen_x86_operand_order(operands, local_addresses);
+
+        std::string out = codegen_x86_expression(
+            operands[order[0]], local_addresses);                   // asm for first operand (stored in eax)
         std::string and_format_str = "    pushl   %%eax\n"          // push first operand to stack
                                      "%s"                           // asm for second operand (stored in eax)
                                      "    pop     %%ecx\n"          // pop first operand to ecx
-                                     "    and     %%eax, %%ecx\n";  // calculate first operand & second operand and store in eax
+                                     "    andl    %%ecx, %%eax\n";  // calculate first operand & second operand and store in eax
 
-        auto expression = exp->expressions.begin();
-        std::advance(expression, 1);
-        for (int i=0; i<exp->expressions.size()-1; i++) {
-            boost::format format_str(and_format_str);
-            format_str % codegen_x86_expression_equality(*expression, local_addresses);
-            out += format_str.str();
-            std::advance(expression, 1);
+        for (int i=1; i<order.size(); i++) {
+            std::string operand;
+            if (codegen_x86_operand(operands[order[i]], local_addresses, operand)) {
+                out += "    andl    " + operand + ", %eax\n";         // operate on the literal or variable in place
+            } else {
+                boost::format format_str(and_format_str);
+                format_str % codegen_x86_expression(operands[order[i]], local_addresses);
+                out += format_str.str();
+            }
         }
         return out;
     }
@@ -604,6 +1684,10 @@ std::string codegen_x86_expression_bitwise_and(std::shared_ptr<ExpressionBitwise
 std::string codegen_x86_expression_equality(std::shared_ptr<ExpressionEquality> exp, std::map<std::string, int> local_addresses) {
     if (exp->expressions.size() == 1) {
         return codegen_x86_expression_relational(exp->expressions.front(), local_addresses);
+    } else if (exp->expressions.size() == 2) {
+        std::string op = exp->operators.front();
+        std::string out = codegen_x86_compare(exp->expressions.front(), op, exp->expressions.back(), local_addresses);
+        return out + "    movl    $0, %eax\n" + comparison_ops[op];    // zero-out eax (keeping FLAGS intact) and set al
     } else {
         std::string out = codegen_x86_expression_relational(
             exp->expressions.front(), local_addresses);             // asm for first operand
@@ -617,9 +1701,16 @@ std::string codegen_x86_expression_equality(std::shared_ptr<ExpressionEquality>
         auto expression = exp->expressions.begin();
         std::advance(expression, 1);
         for (auto op: exp->operators) {
-            boost::format format_str(base_format_str);
-            format_str % codegen_x86_expression_relational(*expression, local_addresses) % comparison_ops[op];
-            out += format_str.str();
+            std::string operand;
+            if (codegen_x86_operand(*expression, local_addresses, operand)) {
+                out += "    cmpl    " + operand + ", %eax\n"          // compare first operand to the literal or variable
+                       "    movl    $0, %eax\n" +                     // zero-out eax (keeping FLAGS intact)
+                       comparison_ops[op];
+            } else {
+                boost::format format_str(base_format_str);
+                format_str % codegen_x86_expression_relational(*expression, local_addresses) % comparison_ops[op];
+                out += format_str.str();
+            }
             std::advance(expression, 1);
         }
         return out;
@@ -629,6 +1720,10 @@ std::string codegen_x86_expression_equality(std::shared_ptr<ExpressionEquality>
 std::string codegen_x86_expression_relational(std::shared_ptr<ExpressionRelational> exp, std::map<std::string, int> local_addresses) {
     if (exp->expressions.size() == 1) {
         return codegen_x86_expression_shift(exp->expressions.front(), local_addresses);
+    } else if (exp->expressions.size() == 2) {
+        std::string op = exp->operators.front();
+        std::string out = codegen_x86_compare(exp->expressions.front(), op, exp->expressions.back(), local_addresses);
+        return out + "    movl    $0, %eax\n" + comparison_ops[op];    // zero-out eax (keeping FLAGS intact) and set al
     } else {
         std::string out = codegen_x86_expression_shift(
             exp->expressions.front(), local_addresses);             // asm for first operand
@@ -642,9 +1737,16 @@ std::string codegen_x86_expression_relational(std::shared_ptr<ExpressionRelation
         auto expression = exp->expressions.begin();
         std::advance(expression, 1);
         for (auto op: exp->operators) {
-            boost::format format_str(base_format_str);
-            format_str % codegen_x86_expression_shift(*expression, local_addresses) % comparison_ops[op];
-            out += format_str.str();
+            std::string operand;
+            if (codegen_x86_operand(*expression, local_addresses, operand)) {
+                out += "    cmpl    " + operand + ", %eax\n"          // compare first operand to the literal or variable
+                       "    movl    $0, %eax\n" +                     // zero-out eax (keeping FLAGS intact)
+                       comparison_ops[op];
+            } else {
+                boost::format format_str(base_format_str);
+                format_str % codegen_x86_expression_shift(*expression, local_addresses) % comparison_ops[op];
+                out += format_str.str();
+            }
             std::advance(expression, 1);
         }
         return out;
@@ -672,7 +1774,12 @@ std::string codegen_x86_expression_shift(std::shared_ptr<ExpressionShift> exp, s
         auto expression = exp->expressions.begin();
         std::advance(expression, 1);
         for (auto op: exp->operators) {
-            if (op == "<<") {
+            int value;
+            if (select_instructions && constant_value(**expression, value)) {
+                boost::format format_str("    %s    $%d, %%eax\n");     // shift by an immediate count
+                format_str % (op == "<<"? "shll": "shrl") % (value & 31);
+                out += format_str.str();
+            } else if (op == "<<") {
                 boost::format format_str(shl_format_str);
                 format_str % codegen_x86_expression_add(*expression, local_addresses);
                 out += format_str.str();
@@ -691,9 +1798,17 @@ std::string codegen_x86_expression_add(std::shared_ptr<ExpressionAdd> exp, std::
     if (exp->expressions.size() == 1) {
         return codegen_x86_expression_mult(exp->expressions.front(), local_addresses);
     } else {
-        std::string out = 
-            codegen_x86_expression_mult(exp->expressions.front(), 
-                                        local_addresses);           // asm for first operand (stored in eax)
+        // a - b + c is evaluated as the terms a, -b and +c, which may be reordered
+        std::vector<std::shared_ptr<Expression>> operands(exp->expressions.begin(), exp->expressions.end());
+        std::vector<std::string> operators = {"+"};
+        operators.insert(operators.end(), exp->operators.begin(), exp->operators.end());
+        auto order = codegen_x86_operand_order(operands, local_addresses);
+
+        std::string out = codegen_x86_expression(
+            operands[order[0]], local_addresses);                   // asm for first operand (stored in eax)
+        if (operators[order[0]] == "-") {
+            out += "    neg     %eax\n";                            // a subtracted term was moved to the front
+        }
         std::string add_format_str = "    pushl   %%eax\n"          // push first operand to stack
                                      "%s"                           // asm for second operand (stored in eax)
                                      "    pop     %%ecx\n"          // pop first operand to ecx
@@ -705,19 +1820,37 @@ std::string codegen_x86_expression_add(std::shared_ptr<ExpressionAdd> exp, std::
                                      "    pop     %%eax\n"          // pop first operand to eax
                                      "    subl    %%ecx, %%eax\n";  // compute eax - ecx and store in eax
 
-        auto exp_mult = exp->expressions.begin();
-        std::advance(exp_mult, 1);
-        for (auto op: exp->operators) {
-            if (op == "+") {
+        for (int i=1; i<order.size(); i++) {
+            auto exp_mult = operands[order[i]];
+            auto op = operators[order[i]];
+            std::string operand, index;
+            int scale, value;
+            if (codegen_x86_operand(exp_mult, local_addresses, operand)) {
+                if (operand == "$1" || operand == "$-1") {
+                    out += (op == "+") == (operand == "$1")? "    incl    %eax\n": "    decl    %eax\n";
+                } else {
+                    out += (op == "+"? "    addl    ": "    subl    ") + operand + ", %eax\n";
+                }
+            } else if (op == "+" && codegen_x86_scaled_index(exp_mult, local_addresses, index, scale)) {
+                // a + b*scale (+ constant) in one lea, folding a following literal into the displacement
+                int displacement = 0;
+                if (i + 1 < order.size() && constant_value(*operands[order[i + 1]], value)) {
+                    displacement = operators[order[i + 1]] == "+"? value: (int) (0u - (unsigned int) value);
+                    i++;
+                }
+                boost::format format_str("    movl    %s, %%ecx\n"         // load the index into ecx
+                                         "    leal    %s(%%eax,%%ecx,%d), %%eax\n");
+                format_str % index % (displacement? std::to_string(displacement): "") % scale;
+                out += format_str.str();
+            } else if (op == "+") {
                 boost::format format_str(add_format_str);
-                format_str % codegen_x86_expression_mult(*exp_mult, local_addresses);
+                format_str % codegen_x86_expression(exp_mult, local_addresses);
                 out += format_str.str();
             } else { // if (op == "-") {
                 boost::format format_str(sub_format_str);
-                format_str % codegen_x86_expression_mult(*exp_mult, local_addresses);
+                format_str % codegen_x86_expression(exp_mult, local_addresses);
                 out += format_str.str();
             }
-            std::advance(exp_mult, 1);
         }
         return out;
     }
@@ -727,9 +1860,21 @@ std::string codegen_x86_expression_mult(std::shared_ptr<ExpressionMult> exp, std
     if (exp->expressions.size() == 1) {
         return codegen_x86_expression_unary(exp->expressions.front(), local_addresses);
     } else {
-        std::string out = 
-            codegen_x86_expression_unary(exp->expressions.front(),
-                                         local_addresses);          // asm for first operand (stored in eax)
+        // only a pure product may be reordered, / and % are not commutative
+        std::vector<std::shared_ptr<Expression>> operands(exp->expressions.begin(), exp->expressions.end());
+        std::vector<std::string> operators = {"*"};
+        operators.insert(operators.end(), exp->operators.begin(), exp->operators.end());
+        std::vector<int> order;
+        if (std::count(operators.begin(), operators.end(), "*") == operators.size()) {
+            order = codegen_x86_operand_order(operands, local_addresses);
+        } else {
+            for (int i=0; i<operands.size(); i++) {
+                order.push_back(i);
+            }
+        }
+
+        std::string out = codegen_x86_expression(
+            operands[order[0]], local_addresses);                   // asm for first operand (stored in eax)
         std::string mul_format_str = "    pushl   %%eax\n"          // push first operand to stack
                                      "%s"                           // asm for second operand (stored in eax)
                                      "    pop     %%ecx\n"          // pop first operand to ecx
@@ -739,29 +1884,48 @@ std::string codegen_x86_expression_mult(std::shared_ptr<ExpressionMult> exp, std
                                      "%s"                           // asm for second operand (stored in eax)
                                      "    movl    %%eax, %%ecx\n"   // move second operand to ecx
                                      "    pop     %%eax\n"          // pop first operand to eax
-                                     "    movl    $0, %%edx\n"      // zero out edx
+                                     "    cdq\n"                     // sign-extend eax into edx
                                      "    idivl   %%ecx\n";         // compute [edx:eax]/ecx, quotient goes to eax, remainder to edx
         
         std::string mod_format_str = div_format_str +
                                      "    movl    %%edx, %%eax\n";  // moves the remainder stored in edx to eax
 
-        auto exp_unary = exp->expressions.begin();
-        std::advance(exp_unary, 1);
-        for (auto op: exp->operators) {
-            if (op == "*") {
+        for (int i=1; i<order.size(); i++) {
+            auto exp_unary = operands[order[i]];
+            auto op = operators[order[i]];
+            int value;
+            std::string operand;
+            if (strength_reduce && constant_value(*exp_unary, value) && (op == "*" || value != 0)) {
+                // literal operands need no evaluation, and division by zero is left to trap at runtime
+                if (op == "*") {
+                    out += codegen_x86_multiply_constant(value);
+                } else if (op == "/") {
+                    out += codegen_x86_divide_constant(value);
+                } else { // if (op == "%") {
+                    out += codegen_x86_modulo_constant(value);
+                }
+            } else if (codegen_x86_operand(exp_unary, local_addresses, operand) && operand[0] != '$') {
+                if (op == "*") {
+                    out += "    imull   " + operand + ", %eax\n";     // multiply by the variable in place
+                } else {
+                    out += "    movl    " + operand + ", %ecx\n"      // divisor to ecx
+                           "    cdq\n"                                 // sign-extend eax into edx
+                           "    idivl   %ecx\n" +
+                           std::string(op == "%"? "    movl    %edx, %eax\n": "");
+                }
+            } else if (op == "*") {
                 boost::format out_format(mul_format_str);
-                out_format % codegen_x86_expression_unary(*exp_unary, local_addresses);
+                out_format % codegen_x86_expression(exp_unary, local_addresses);
                 out += out_format.str();
             } else if (op == "/") {
                 boost::format out_format(div_format_str);
-                out_format % codegen_x86_expression_unary(*exp_unary, local_addresses);
+                out_format % codegen_x86_expression(exp_unary, local_addresses);
                 out += out_format.str();
             } else { // if (*op == "%") {
                 boost::format out_format(mod_format_str);
-                out_format % codegen_x86_expression_unary(*exp_unary, local_addresses);
+                out_format % codegen_x86_expression(exp_unary, local_addresses);
                 out += out_format.str();
             }
-            std::advance(exp_unary, 1);
         }
         return out;
     }
@@ -838,27 +2002,36 @@ std::string codegen_x86_expression_postfix(std::shared_ptr<ExpressionPostfix> ex
             "%s"                          // asm for function arguments
             "    call    _%s\n"           // push return address and jump to function label
         );
-        std::string args = "";
-        int arg_count = 0;
-        auto arg = exp->args.rbegin();
-        for (int i=0; i<exp->args.size(); i++) {
-            boost::format arg_format(
-                "%s"                        // asm for argument value
-                "    pushl   %%eax\n"       // push argument to stack
-            );
-            arg_format % codegen_x86_expression_assignment(*arg, local_addresses);
-            args += arg_format.str();
-
-            std::advance(arg, 1);
-            arg_count++;
-        }
-        out_format % args % exp->id;
+        out_format % codegen_x86_arguments(exp, local_addresses) % exp->id;
         
         boost::format dealloc_format("");
-        if (arg_count) {
+        if (exp->args.size()) {
             dealloc_format = boost::format("    addl    $%d, %%esp\n");
-            dealloc_format % (4*arg_count);
+            dealloc_format % (4*exp->args.size());
         }
         return out_format.str() + dealloc_format.str();;
     }
-}
\ No newline at end of file
+}
+
+// pushes the arguments of a function call, last first, so the first ends up on top
+std::string codegen_x86_arguments(std::shared_ptr<ExpressionPostfix> exp, std::map<std::string, int> local_addresses) {
+    std::string args = "";
+    auto arg = exp->args.rbegin();
+    for (int i=0; i<exp->args.size(); i++) {
+        std::string operand;
+        if (codegen_x86_operand(*arg, local_addresses, operand)) {
+            args += "    pushl   " + operand + "\n";            // push the literal or variable argument directly
+            std::advance(arg, 1);
+            continue;
+        }
+        boost::format arg_format(
+            "%s"                        // asm for argument value
+            "    pushl   %%eax\n"       // push argument to stack
+        );
+        arg_format % codegen_x86_expression_assignment(*arg, local_addresses);
+        args += arg_format.str();
+
+        std::advance(arg, 1);
+    }
+    return args;
+}
@@ -1,19 +1,103 @@
 #include <fstream>
 #include <iostream>
 
+#include "timing.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
 // #include "typechecker.hpp"
+#include "optimiser.hpp"
 #include "codegen.hpp"
 
+// the codegen improvements that -O0 and -fno-<name> turn off, alongside the optimiser's passes
+std::set<std::string> codegen_passes = {"strength-reduce", "select-instructions", "rotate-loops",
+                                         "omit-frame-pointer", "peephole", "cmov"};
+
+// the integer after option (e.g. "-funroll-factor=") in arg, stopping with an error if it is not one
+int option_value(std::string arg, std::string option) {
+    std::string text = arg.substr(option.size());
+    size_t used = 0;
+    int value = 0;
+    try {
+        value = std::stoi(text, &used);
+    } catch (std::logic_error) {
+        used = 0;
+    }
+    if (text.empty() || used != text.size()) {
+        std::cout << "Error: bad value for " << option.substr(0, option.size() - 1) << "\n";
+        exit(1);
+    }
+    return value;
+}
+
 int main(int argc, char* argv[]) {
+    std::string filename;
+    std::string time_report = "";   // "", "text" or "json"
+    std::string trace_path = "";
+    bool opt_stats = false;
+    OptimiserOptions options;
+
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-ftime-report") {
+            time_report = "text";
+        } else if (arg.find("-ftime-report=") == 0) {
+            time_report = arg.substr(std::string("-ftime-report=").size());
+            if (time_report != "text" && time_report != "json") {
+                std::cout << "Error: unknown time report format: " << time_report << "\n";
+                exit(1);
+            }
+        } else if (arg.find("--trace=") == 0) {
+            trace_path = arg.substr(std::string("--trace=").size());
+            trace_enabled = true;
+        } else if (arg == "-fopt-stats") {
+            opt_stats = true;
+        } else if (arg.find("-funroll-factor=") == 0) {
+            options.unroll_factor = option_value(arg, "-funroll-factor=");
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            options.level = arg[2] - '0';
+        } else if (arg.find("-fno-") == 0) {
+            std::string pass = arg.substr(std::string("-fno-").size());
+            if (!is_optimiser_pass(pass) && !codegen_passes.count(pass)) {
+                std::cout << "Error: unknown pass: " << pass << "\n";
+                exit(1);
+            }
+            options.disabled.insert(pass);
+        } else if (arg.find("-fcmov=") == 0) {
+            cmov_policy = arg.substr(std::string("-fcmov=").size());
+            if (cmov_policy != "auto" && cmov_policy != "always" && cmov_policy != "never") {
+                std::cout << "Error: unknown cmov policy: " << cmov_policy << "\n";
+                exit(1);
+            }
+        } else if (arg.find("-finline-limit=") == 0) {
+            options.inline_limit = option_value(arg, "-finline-limit=");
+        } else if (arg.find("-fbalance-chains=") == 0) {
+            options.balance_chains = option_value(arg, "-fbalance-chains=");
+        } else {
+            filename = arg;
+        }
+    }
+
+    // the codegen improvements switch on and off with the optimiser's passes
+    strength_reduce = options.runs("strength-reduce", 1);
+    select_instructions = options.runs("select-instructions", 1);
+    rotate_loops = options.runs("rotate-loops", 1);
+    omit_frame_pointer = options.runs("omit-frame-pointer", 1);
+    peephole = options.runs("peephole", 1);
+    if (!options.runs("cmov", 1)) {
+        cmov_policy = "never";
+    }
+
     std::ifstream file;
-    file.open(argv[1]);
+    file.open(filename);
 
+    PhaseTimer lex_timer("lex");
     std::list<std::string> tokens = lex(file);
+    lex_timer.stop();
 
     try {
+        PhaseTimer parse_timer("parse");
         auto prog = parse_program(tokens);
+        parse_timer.stop();
 
         // typecheck_program(prog);
 
@@ -21,16 +105,47 @@ int main(int argc, char* argv[]) {
         json ast = jsonify_program(prog);
         std::cout << ast.dump(4) << "\n";
 #endif
+        std::string unoptimised = "";
+        if (opt_stats) {
+            unoptimised = codegen_x86(prog);    // baseline for the report, not timed
+            global_functions.clear();
+        }
+
+        PhaseTimer optimise_timer("optimise");
+        optimise_program(prog, options);
+        optimise_timer.stop();
+
+        PhaseTimer codegen_timer("codegen");
+        std::string assembly = codegen_x86(prog);
+        codegen_timer.stop();
+
+        PhaseTimer emit_timer("emit");
         std::filebuf fb;
         fb.open("out.s", std::ios::out);
         std::ostream asm_out(&fb);
-        asm_out << codegen_x86(prog);
+        asm_out << assembly;
         fb.close();
+        emit_timer.stop();
 
+        PhaseTimer assemble_timer("assemble+link");
         system("gcc -m32 -o a.exe out.s");
+        assemble_timer.stop();
+
+        if (opt_stats) {
+            std::cerr << optimisation_report_text(unoptimised, assembly);
+        }
 
+        if (trace_path != "") {
+            write_trace(trace_path);
+        }
     } catch (const std::runtime_error& e) {
         std::cout << "Error: " << e.what();
         exit(1);
     }
-}
\ No newline at end of file
+
+    if (time_report == "text") {
+        std::cerr << time_report_text();
+    } else if (time_report == "json") {
+        std::cerr << time_report_json();
+    }
+}
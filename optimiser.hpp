@@ -0,0 +1,3324 @@
+#ifndef OPTIMISER
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parser.hpp"
+#include "timing.hpp"
+#include <boost/format.hpp>
+
+// tuning knobs for the passes, set from the command line
+class OptimiserOptions {
+    public:
+    int unroll_factor = 4;      // copies of the body per iteration of an unrolled loop (1 disables)
+    int unroll_budget = 64;     // maximum size of an unrolled body, in AST operations
+    int full_unroll_trips = 16; // constant trip counts up to which a loop is unrolled completely
+    int inline_limit = 40;      // maximum size of an inlined function body, in AST operations (0 disables)
+    int balance_chains = 0;     // operand count from which associative chains become balanced trees (0 disables)
+    int level = 2;              // -O level: 0 runs nothing, 1 the cheap passes, 2 everything
+    std::set<std::string> disabled;     // passes turned off with -fno-<name>
+
+    // whether the pass called name, which starts at -O min_level, runs
+    bool runs(std::string name, int min_level) {
+        return level >= min_level && !disabled.count(name);
+    }
+};
+
+// counts of what each pass changed, per function, e.g. optimisation_stats["main"]["dead stores"]
+std::map<std::string, std::map<std::string, int>> optimisation_stats;
+
+void count_optimisation(std::string function, std::string counter, int n = 1) {
+    if (n) {
+        optimisation_stats[function][counter] += n;
+    }
+}
+
+// what was done where, per function, for the report
+std::map<std::string, std::vector<std::string>> optimisation_notes;
+
+void note_optimisation(std::string function, std::string note) {
+    optimisation_notes[function].push_back(note);
+}
+
+// ---------------------------------------------------------------------------------------------
+// AST utilities shared by the passes
+
+// whether exp contains a function call
+bool contains_call(Expression& exp) {
+    if (exp.exp_class == ExpClass::postfix &&
+        dynamic_cast<ExpressionPostfix&>(exp).exp_type == "function_call") {
+        return true;
+    }
+    bool call = false;
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        call = call || contains_call(*child);
+    });
+    return call;
+}
+
+// whether evaluating exp can do anything but produce its value
+bool has_side_effects(Expression& exp) {
+    return writes_variables(exp) || contains_call(exp);
+}
+
+// a statement that does nothing (what the parser builds for a lone ';')
+std::shared_ptr<Statement> null_statement() {
+    auto stat = std::shared_ptr<Statement>(new Statement);
+    stat->statement_type = "expression";
+    stat->expression1 = std::shared_ptr<ExpressionComma>(new ExpressionComma);
+    stat->expression1->exp_class = ExpClass::comma;
+    stat->expression1->exp_type = "null";
+    return stat;
+}
+
+bool is_null_statement(std::shared_ptr<Statement> stat) {
+    return stat->statement_type == "expression" && stat->expression1->exp_type == "null";
+}
+
+// an expression statement evaluating exp
+std::shared_ptr<Statement> expression_statement(std::shared_ptr<ExpressionAssignment> exp) {
+    auto stat = null_statement();
+    stat->expression1->exp_type = "assignment";
+    stat->expression1->expressions.push_back(exp);
+    return stat;
+}
+
+// stat's direct substatements: the branches or loop body, then the statements of its block items
+void for_each_child_statement(std::shared_ptr<Statement> stat, std::function<void(std::shared_ptr<Statement>&)> fn) {
+    if (stat->statement1) fn(stat->statement1);
+    if (stat->statement2) fn(stat->statement2);
+    for (auto item: stat->items) {
+        if (item->item_type == "statement") {
+            fn(item->statement);
+        }
+    }
+}
+
+// every statement in a function body, outermost first
+void for_each_statement(std::shared_ptr<Statement> stat, std::function<void(std::shared_ptr<Statement>)> fn) {
+    fn(stat);
+    for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+        for_each_statement(child, fn);
+    });
+}
+
+void for_each_statement(std::shared_ptr<Function> function, std::function<void(std::shared_ptr<Statement>)> fn) {
+    for (auto item: function->items) {
+        if (item->item_type == "statement") {
+            for_each_statement(item->statement, fn);
+        }
+    }
+}
+
+// every declaration in a function body, including those in for loop headers
+void for_each_declaration(std::shared_ptr<Function> function, std::function<void(std::shared_ptr<Declaration>)> fn) {
+    auto visit_items = [&](std::list<std::shared_ptr<BlockItem>>& items) {
+        for (auto item: items) {
+            if (item->item_type != "statement") {
+                for (auto decl: item->declaration_list->declarations) {
+                    fn(decl);
+                }
+            }
+        }
+    };
+    visit_items(function->items);
+    for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+        visit_items(stat->items);
+    });
+}
+
+// an expression statement evaluating a comma expression
+std::shared_ptr<Statement> comma_statement(std::shared_ptr<ExpressionComma> exp) {
+    auto stat = null_statement();
+    stat->expression1 = exp;
+    return stat;
+}
+
+// the size of stat in operations: statements, and expression nodes that are not just wrappers
+// around a single operand
+int statement_size(std::shared_ptr<Statement> stat);
+
+int expression_size(Expression& exp) {
+    int size = singleton_child(exp)? 0: 1;
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        size += expression_size(*child);
+    });
+    return size;
+}
+
+int statement_size(std::shared_ptr<Statement> stat) {
+    int size = 1;
+    for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+        if (exp) size += expression_size(*exp);
+    }
+    for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+        size += statement_size(child);
+    });
+    for (auto item: stat->items) {
+        if (item->item_type == "declaration") {
+            for (auto decl: item->declaration_list->declarations) {
+                size += 1 + (decl->initialised? expression_size(*decl->init_exp): 0);
+            }
+        }
+    }
+    return size;
+}
+
+// the variable exp assigns, increments or decrements, or "" if it is none of those
+std::string assigned_variable(Expression& exp) {
+    if (exp.exp_class == ExpClass::assignment) {
+        auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+        if (exp_assign.exp_type == "assignment") {
+            return exp_assign.assign_id;
+        }
+    } else if (exp.exp_class == ExpClass::unary) {
+        auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+        if (exp_unary.exp_type == "prefix") {
+            return exp_unary.prefix_id;
+        }
+    } else if (exp.exp_class == ExpClass::postfix) {
+        auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+        if (exp_post.exp_type == "postfix") {
+            return exp_post.id;
+        }
+    }
+    return "";
+}
+
+// the variable stored to at the top level of exp, looking through single-operand wrappers
+std::string stored_variable(std::shared_ptr<Expression> exp) {
+    return assigned_variable(*innermost_expression(exp));
+}
+
+// every variable exp assigns, increments or decrements
+void collect_assigned_variables(Expression& exp, std::set<std::string>& variables) {
+    auto variable = assigned_variable(exp);
+    if (variable != "") {
+        variables.insert(variable);
+    }
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        collect_assigned_variables(*child, variables);
+    });
+}
+
+template <class T>
+std::shared_ptr<Expression> copy_as(Expression& exp) {
+    return std::shared_ptr<Expression>(new T(dynamic_cast<T&>(exp)));
+}
+
+template <class T>
+void replace_as(Expression& target, Expression& source) {
+    dynamic_cast<T&>(target) = dynamic_cast<T&>(source);
+}
+
+// a copy of exp sharing its subexpressions
+std::shared_ptr<Expression> copy_expression(Expression& exp) {
+    switch (exp.exp_class) {
+        case ExpClass::comma: return copy_as<ExpressionComma>(exp);
+        case ExpClass::assignment: return copy_as<ExpressionAssignment>(exp);
+        case ExpClass::conditional: return copy_as<ExpressionConditional>(exp);
+        case ExpClass::logicor: return copy_as<ExpressionLogicOr>(exp);
+        case ExpClass::logicand: return copy_as<ExpressionLogicAnd>(exp);
+        case ExpClass::bitwiseor: return copy_as<ExpressionBitwiseOr>(exp);
+        case ExpClass::bitwisexor: return copy_as<ExpressionBitwiseXor>(exp);
+        case ExpClass::bitwiseand: return copy_as<ExpressionBitwiseAnd>(exp);
+        case ExpClass::equality: return copy_as<ExpressionEquality>(exp);
+        case ExpClass::relational: return copy_as<ExpressionRelational>(exp);
+        case ExpClass::shift: return copy_as<ExpressionShift>(exp);
+        case ExpClass::add: return copy_as<ExpressionAdd>(exp);
+        case ExpClass::mult: return copy_as<ExpressionMult>(exp);
+        case ExpClass::unary: return copy_as<ExpressionUnary>(exp);
+        default: return copy_as<ExpressionPostfix>(exp);
+    }
+}
+
+// overwrites target with source in place, so every reference to target sees the new
+// expression. Both must be of the same class.
+void replace_expression(Expression& target, Expression& source) {
+    switch (target.exp_class) {
+        case ExpClass::comma: replace_as<ExpressionComma>(target, source); break;
+        case ExpClass::assignment: replace_as<ExpressionAssignment>(target, source); break;
+        case ExpClass::conditional: replace_as<ExpressionConditional>(target, source); break;
+        case ExpClass::logicor: replace_as<ExpressionLogicOr>(target, source); break;
+        case ExpClass::logicand: replace_as<ExpressionLogicAnd>(target, source); break;
+        case ExpClass::bitwiseor: replace_as<ExpressionBitwiseOr>(target, source); break;
+        case ExpClass::bitwisexor: replace_as<ExpressionBitwiseXor>(target, source); break;
+        case ExpClass::bitwiseand: replace_as<ExpressionBitwiseAnd>(target, source); break;
+        case ExpClass::equality: replace_as<ExpressionEquality>(target, source); break;
+        case ExpClass::relational: replace_as<ExpressionRelational>(target, source); break;
+        case ExpClass::shift: replace_as<ExpressionShift>(target, source); break;
+        case ExpClass::add: replace_as<ExpressionAdd>(target, source); break;
+        case ExpClass::mult: replace_as<ExpressionMult>(target, source); break;
+        case ExpClass::unary: replace_as<ExpressionUnary>(target, source); break;
+        case ExpClass::postfix: replace_as<ExpressionPostfix>(target, source); break;
+    }
+}
+
+// replaces each direct subexpression of exp by fn applied to it, in source order
+void transform_child_expressions(Expression& exp, std::function<std::shared_ptr<Expression>(std::shared_ptr<Expression>)> fn) {
+    switch (exp.exp_class) {
+        case ExpClass::comma:
+            for (auto& child: dynamic_cast<ExpressionComma&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionAssignment>(fn(child));
+            }
+            break;
+        case ExpClass::assignment: {
+            auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+            if (exp_assign.exp_type == "assignment") {
+                exp_assign.assign_exp = std::static_pointer_cast<ExpressionAssignment>(fn(exp_assign.assign_exp));
+            } else {
+                exp_assign.expression = std::static_pointer_cast<ExpressionConditional>(fn(exp_assign.expression));
+            }
+            break;
+        }
+        case ExpClass::conditional: {
+            auto& exp_cond = dynamic_cast<ExpressionConditional&>(exp);
+            exp_cond.condition = std::static_pointer_cast<ExpressionLogicOr>(fn(exp_cond.condition));
+            if (exp_cond.exp_type == "conditional") {
+                exp_cond.exp_true = std::static_pointer_cast<ExpressionComma>(fn(exp_cond.exp_true));
+                exp_cond.exp_false = std::static_pointer_cast<ExpressionConditional>(fn(exp_cond.exp_false));
+            }
+            break;
+        }
+        case ExpClass::logicor:
+            for (auto& child: dynamic_cast<ExpressionLogicOr&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionLogicAnd>(fn(child));
+            }
+            break;
+        case ExpClass::logicand:
+            for (auto& child: dynamic_cast<ExpressionLogicAnd&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionBitwiseOr>(fn(child));
+            }
+            break;
+        case ExpClass::bitwiseor:
+            for (auto& child: dynamic_cast<ExpressionBitwiseOr&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionBitwiseXor>(fn(child));
+            }
+            break;
+        case ExpClass::bitwisexor:
+            for (auto& child: dynamic_cast<ExpressionBitwiseXor&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionBitwiseAnd>(fn(child));
+            }
+            break;
+        case ExpClass::bitwiseand:
+            for (auto& child: dynamic_cast<ExpressionBitwiseAnd&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionEquality>(fn(child));
+            }
+            break;
+        case ExpClass::equality:
+            for (auto& child: dynamic_cast<ExpressionEquality&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionRelational>(fn(child));
+            }
+            break;
+        case ExpClass::relational:
+            for (auto& child: dynamic_cast<ExpressionRelational&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionShift>(fn(child));
+            }
+            break;
+        case ExpClass::shift:
+            for (auto& child: dynamic_cast<ExpressionShift&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionAdd>(fn(child));
+            }
+            break;
+        case ExpClass::add:
+            for (auto& child: dynamic_cast<ExpressionAdd&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionMult>(fn(child));
+            }
+            break;
+        case ExpClass::mult:
+            for (auto& child: dynamic_cast<ExpressionMult&>(exp).expressions) {
+                child = std::static_pointer_cast<ExpressionUnary>(fn(child));
+            }
+            break;
+        case ExpClass::unary: {
+            auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+            if (exp_unary.exp_type == "unary_op") {
+                exp_unary.unary_exp = std::static_pointer_cast<ExpressionUnary>(fn(exp_unary.unary_exp));
+            } else if (exp_unary.exp_type == "postfix") {
+                exp_unary.postfix_exp = std::static_pointer_cast<ExpressionPostfix>(fn(exp_unary.postfix_exp));
+            }
+            break;
+        }
+        case ExpClass::postfix: {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+            if (exp_post.exp_type == "bracket_exp") {
+                exp_post.bracket_exp = std::static_pointer_cast<ExpressionComma>(fn(exp_post.bracket_exp));
+            } else if (exp_post.exp_type == "function_call") {
+                for (auto& arg: exp_post.args) {
+                    arg = std::static_pointer_cast<ExpressionAssignment>(fn(arg));
+                }
+            }
+            break;
+        }
+    }
+}
+
+// a copy of the whole tree under exp
+std::shared_ptr<Expression> clone_expression(std::shared_ptr<Expression> exp) {
+    auto clone = copy_expression(*exp);
+    transform_child_expressions(*clone, clone_expression);
+    return clone;
+}
+
+template <class T>
+std::shared_ptr<T> clone_as(std::shared_ptr<T> exp) {
+    return exp? std::static_pointer_cast<T>(clone_expression(exp)): nullptr;
+}
+
+std::shared_ptr<BlockItem> clone_block_item(std::shared_ptr<BlockItem> item);
+
+// a copy of the whole tree under stat, sharing nothing with it
+std::shared_ptr<Statement> clone_statement(std::shared_ptr<Statement> stat) {
+    if (!stat) {
+        return nullptr;
+    }
+    auto clone = std::shared_ptr<Statement>(new Statement(*stat));
+    clone->expression1 = clone_as(stat->expression1);
+    clone->expression2 = clone_as(stat->expression2);
+    clone->expression3 = clone_as(stat->expression3);
+    clone->statement1 = clone_statement(stat->statement1);
+    clone->statement2 = clone_statement(stat->statement2);
+    clone->items.clear();
+    for (auto item: stat->items) {
+        clone->items.push_back(clone_block_item(item));
+    }
+    return clone;
+}
+
+std::shared_ptr<BlockItem> clone_block_item(std::shared_ptr<BlockItem> item) {
+    auto clone = std::shared_ptr<BlockItem>(new BlockItem(*item));
+    if (item->item_type == "statement") {
+        clone->statement = clone_statement(item->statement);
+    } else {
+        clone->declaration_list = std::shared_ptr<DeclarationList>(new DeclarationList(*item->declaration_list));
+        clone->declaration_list->declarations.clear();
+        for (auto decl: item->declaration_list->declarations) {
+            auto decl_clone = std::shared_ptr<Declaration>(new Declaration(*decl));
+            decl_clone->init_exp = clone_as(decl->init_exp);
+            clone->declaration_list->declarations.push_back(decl_clone);
+        }
+    }
+    return clone;
+}
+
+// the node of class exp_class in the chain of single-operand wrappers starting at exp
+std::shared_ptr<Expression> wrapper_at(std::shared_ptr<Expression> exp, ExpClass exp_class) {
+    while (exp->exp_class != exp_class) {
+        exp = singleton_child(*exp);
+    }
+    return exp;
+}
+
+// a comma expression that just reads variable id, wrapped down through every class so any
+// level of it can stand in for a subexpression. id need not be a valid identifier, which
+// keeps the optimiser's temporaries apart from the program's own variables.
+std::shared_ptr<ExpressionComma> variable_expression(std::string id) {
+    std::list<std::string> tokens = {"v", ";"};
+    auto exp = parse_expression_comma(tokens);
+    auto& variable = dynamic_cast<ExpressionPostfix&>(*wrapper_at(exp, ExpClass::postfix));
+    variable.id = id;
+    return exp;
+}
+
+// exp wrapped up to a comma expression
+std::shared_ptr<ExpressionComma> comma_expression(Expression& exp) {
+    auto comma = variable_expression("");
+    replace_expression(*wrapper_at(comma, exp.exp_class), exp);
+    return comma;
+}
+
+// an integer literal (any int, unlike what the lexer can produce)
+std::shared_ptr<ExpressionComma> constant_expression(int value) {
+    std::list<std::string> tokens = {"0", ";"};
+    auto exp = parse_expression_comma(tokens);
+    dynamic_cast<ExpressionPostfix&>(*wrapper_at(exp, ExpClass::postfix)).value_int = value;
+    return exp;
+}
+
+// builds an expression from source tokens, substituting operands for the variables they name, e.g.
+// build_expression({"a", "<", "b"}, {{"a", i}, {"b", limit}})
+std::shared_ptr<ExpressionComma> build_expression(std::list<std::string> tokens, std::map<std::string, std::shared_ptr<Expression>> operands) {
+    tokens.push_back(";");
+    auto exp = parse_expression_comma(tokens);
+    std::function<void(Expression&)> substitute = [&](Expression& node) {
+        if (node.exp_class == ExpClass::postfix) {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(node);
+            if (exp_post.exp_type == "variable" && operands.count(exp_post.id)) {
+                exp_post.exp_type = "bracket_exp";
+                exp_post.bracket_exp = comma_expression(*clone_expression(operands[exp_post.id]));
+                return;
+            }
+        }
+        for_each_child_expression(node, [&](std::shared_ptr<Expression> child) {
+            substitute(*child);
+        });
+    };
+    substitute(*exp);
+    return exp;
+}
+
+// a declaration item "int id = exp;" where exp may be of any class (a comma expression only
+// with a single operand)
+std::shared_ptr<BlockItem> temporary_declaration(std::string id, Expression& exp) {
+    if (exp.exp_class == ExpClass::comma) {
+        return temporary_declaration(id, *singleton_child(exp));
+    }
+    auto init = std::static_pointer_cast<ExpressionAssignment>(wrapper_at(variable_expression(id), ExpClass::assignment));
+    replace_expression(*wrapper_at(init, exp.exp_class), exp);
+
+    auto decl = std::shared_ptr<Declaration>(new Declaration);
+    decl->var_id = id;
+    decl->initialised = true;
+    decl->init_exp = init;
+    auto item = std::shared_ptr<BlockItem>(new BlockItem);
+    item->item_type = "declaration";
+    item->declaration_list = std::shared_ptr<DeclarationList>(new DeclarationList);
+    item->declaration_list->var_type = "int";
+    item->declaration_list->declarations.push_back(decl);
+    return item;
+}
+
+// a declaration item "int id;"
+std::shared_ptr<BlockItem> variable_declaration(std::string id) {
+    auto decl = std::shared_ptr<Declaration>(new Declaration);
+    decl->var_id = id;
+    auto item = std::shared_ptr<BlockItem>(new BlockItem);
+    item->item_type = "declaration";
+    item->declaration_list = std::shared_ptr<DeclarationList>(new DeclarationList);
+    item->declaration_list->var_type = "int";
+    item->declaration_list->declarations.push_back(decl);
+    return item;
+}
+
+// a block item holding stat
+std::shared_ptr<BlockItem> statement_item(std::shared_ptr<Statement> stat) {
+    auto item = std::shared_ptr<BlockItem>(new BlockItem);
+    item->item_type = "statement";
+    item->statement = stat;
+    return item;
+}
+
+// every variable exp mentions, whether read or written
+void collect_variables(Expression& exp, std::set<std::string>& variables) {
+    if (exp.exp_class == ExpClass::postfix) {
+        auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+        if (exp_post.exp_type == "variable" || exp_post.exp_type == "postfix") {
+            variables.insert(exp_post.id);
+        }
+    }
+    auto variable = assigned_variable(exp);
+    if (variable != "") {
+        variables.insert(variable);
+    }
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        collect_variables(*child, variables);
+    });
+}
+
+// whether evaluating exp can fault: a division or modulo by anything but a constant other than
+// 0 and -1
+bool can_trap(Expression& exp) {
+    if (exp.exp_class == ExpClass::mult) {
+        auto& exp_mult = dynamic_cast<ExpressionMult&>(exp);
+        auto operand = std::next(exp_mult.expressions.begin());
+        for (auto op: exp_mult.operators) {
+            int value;
+            if ((op == "/" || op == "%") && !(constant_value(**operand, value) && value != 0 && value != -1)) {
+                return true;
+            }
+            operand++;
+        }
+    }
+    bool trap = false;
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        trap = trap || can_trap(*child);
+    });
+    return trap;
+}
+
+// the operators between the operands of a binary expression, in order (the logical and bitwise
+// classes have only the one), or none for any other class
+std::list<std::string> operators_of(Expression& exp) {
+    static const std::map<ExpClass, std::string> implicit = {
+        {ExpClass::logicor, "||"}, {ExpClass::logicand, "&&"}, {ExpClass::bitwiseor, "|"},
+        {ExpClass::bitwisexor, "^"}, {ExpClass::bitwiseand, "&"}
+    };
+    switch (exp.exp_class) {
+        case ExpClass::equality: return dynamic_cast<ExpressionEquality&>(exp).operators;
+        case ExpClass::relational: return dynamic_cast<ExpressionRelational&>(exp).operators;
+        case ExpClass::shift: return dynamic_cast<ExpressionShift&>(exp).operators;
+        case ExpClass::add: return dynamic_cast<ExpressionAdd&>(exp).operators;
+        case ExpClass::mult: return dynamic_cast<ExpressionMult&>(exp).operators;
+        default: break;
+    }
+    std::list<std::string> operators;
+    if (implicit.count(exp.exp_class)) {
+        bool first = true;
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            if (!first) operators.push_back(implicit.at(exp.exp_class));
+            first = false;
+        });
+    }
+    return operators;
+}
+
+// ---------------------------------------------------------------------------------------------
+// inlining
+
+// every function called in exp
+void collect_calls(Expression& exp, std::set<std::string>& calls) {
+    if (exp.exp_class == ExpClass::postfix) {
+        auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+        if (exp_post.exp_type == "function_call") {
+            calls.insert(exp_post.id);
+        }
+    }
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        collect_calls(*child, calls);
+    });
+}
+
+// renames every variable read, written or declared in stat
+void rename_variables(Expression& exp, std::function<std::string(std::string)> rename) {
+    if (exp.exp_class == ExpClass::postfix) {
+        auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+        if (exp_post.exp_type == "variable" || exp_post.exp_type == "postfix") {
+            exp_post.id = rename(exp_post.id);
+        }
+    } else if (exp.exp_class == ExpClass::assignment) {
+        auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+        if (exp_assign.exp_type == "assignment") {
+            exp_assign.assign_id = rename(exp_assign.assign_id);
+        }
+    } else if (exp.exp_class == ExpClass::unary) {
+        auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+        if (exp_unary.exp_type == "prefix") {
+            exp_unary.prefix_id = rename(exp_unary.prefix_id);
+        }
+    }
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        rename_variables(*child, rename);
+    });
+}
+
+void rename_variables(std::shared_ptr<Statement> stat, std::function<std::string(std::string)> rename) {
+    for_each_statement(stat, [&](std::shared_ptr<Statement> inner) {
+        for (auto exp: {inner->expression1, inner->expression2, inner->expression3}) {
+            if (exp) rename_variables(*exp, rename);
+        }
+        for (auto item: inner->items) {
+            if (item->item_type == "declaration") {
+                for (auto decl: item->declaration_list->declarations) {
+                    decl->var_id = rename(decl->var_id);
+                    if (decl->initialised) rename_variables(*decl->init_exp, rename);
+                }
+            }
+        }
+    });
+}
+
+// Inlines calls to small functions defined in the program, callees first so their own inlined
+// calls come along. A call is inlined where it is the whole of an expression statement, the
+// right hand side of an assignment statement, the initialiser of a single declaration or the
+// value of a return:
+//     x += f(a, b);   =>   int r; inline { int f.a = a; int f.b = b; <body of f> } x += r;
+// The body's variables get names of their own (a function can only see its own parameters and
+// locals, so every name in it is renamed), and each of its returns becomes an inline_return that
+// stores r and jumps past the end of the block. Recursive functions (directly or through others)
+// and bodies larger than inline_limit operations are never inlined.
+class Inliner {
+    public:
+    Inliner(Program& prog, OptimiserOptions options): prog(prog), options(options) {}
+
+    void run() {
+        for (auto function: prog.functions) {
+            if (function->defined) {
+                functions[function->id] = function;
+            }
+        }
+        for (auto function: functions) {
+            auto& callees = calls[function.first];
+            for (auto item: function.second->items) {
+                for_each_item_expression(item, [&](Expression& exp) {
+                    collect_calls(exp, callees);
+                });
+            }
+        }
+
+        std::set<std::string> visited;
+        for (auto function: prog.functions) {
+            if (function->defined) {
+                inline_in_order(function->id, visited);
+            }
+        }
+    }
+
+    private:
+    Program& prog;
+    OptimiserOptions options;
+    std::map<std::string, std::shared_ptr<Function>> functions;     // defined functions
+    std::map<std::string, std::set<std::string>> calls;             // call graph
+    int inlined = 0;
+
+    void for_each_item_expression(std::shared_ptr<BlockItem> item, std::function<void(Expression&)> fn) {
+        auto visit_declarations = [&](std::list<std::shared_ptr<BlockItem>>& items) {
+            for (auto item: items) {
+                if (item->item_type == "declaration") {
+                    for (auto decl: item->declaration_list->declarations) {
+                        if (decl->initialised) fn(*decl->init_exp);
+                    }
+                }
+            }
+        };
+        std::list<std::shared_ptr<BlockItem>> items = {item};
+        visit_declarations(items);
+        if (item->item_type == "statement") {
+            for_each_statement(item->statement, [&](std::shared_ptr<Statement> stat) {
+                for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+                    if (exp) fn(*exp);
+                }
+                visit_declarations(stat->items);
+            });
+        }
+    }
+
+    // whether function can end up calling itself
+    bool is_recursive(std::string function) {
+        std::set<std::string> reached;
+        std::list<std::string> pending(calls[function].begin(), calls[function].end());
+        while (!pending.empty()) {
+            auto callee = pending.front();
+            pending.pop_front();
+            if (callee == function) {
+                return true;
+            } else if (reached.insert(callee).second) {
+                pending.insert(pending.end(), calls[callee].begin(), calls[callee].end());
+            }
+        }
+        return false;
+    }
+
+    int body_size(std::shared_ptr<Function> function) {
+        auto body = std::shared_ptr<Statement>(new Statement);
+        body->statement_type = "compound";
+        body->items = function->items;
+        return statement_size(body) - 1;
+    }
+
+    void inline_in_order(std::string id, std::set<std::string>& visited) {
+        if (!visited.insert(id).second) {
+            return;
+        }
+        for (auto callee: calls[id]) {
+            if (functions.count(callee)) {
+                inline_in_order(callee, visited);
+            }
+        }
+        TraceScope trace("inline " + id, "optimise");
+        inline_calls(functions[id], functions[id]->items);
+    }
+
+    // the call that is all of exp, if it is to a function that can be inlined into caller
+    std::shared_ptr<ExpressionPostfix> inlinable_call(std::shared_ptr<Expression> exp, std::shared_ptr<Function> caller) {
+        auto inner = innermost_expression(exp);
+        if (inner->exp_class != ExpClass::postfix) {
+            return nullptr;
+        }
+        auto call = std::static_pointer_cast<ExpressionPostfix>(inner);
+        if (call->exp_type != "function_call" || !functions.count(call->id) || call->id == caller->id) {
+            return nullptr;
+        }
+        auto callee = functions[call->id];
+        for (auto param: callee->params) {
+            if (param.second == "") {
+                return nullptr;
+            }
+        }
+        if (callee->params.size() != call->args.size() || is_recursive(callee->id) ||
+            body_size(callee) > options.inline_limit) {
+            return nullptr;
+        }
+        return call;
+    }
+
+    // the call an item could have inlined, and whether its value is used
+    std::shared_ptr<ExpressionPostfix> call_site(std::shared_ptr<BlockItem> item, std::shared_ptr<Function> caller, bool& used) {
+        used = true;
+        if (item->item_type == "declaration") {
+            auto& declarations = item->declaration_list->declarations;
+            if (declarations.size() == 1 && declarations.front()->initialised) {
+                return inlinable_call(declarations.front()->init_exp, caller);
+            }
+            return nullptr;
+        }
+        auto stat = item->statement;
+        if (stat->statement_type == "return") {
+            return inlinable_call(stat->expression1, caller);
+        } else if (stat->statement_type != "expression" || stat->expression1->exp_type == "null" ||
+                   stat->expression1->expressions.size() != 1) {
+            return nullptr;
+        }
+        auto inner = innermost_expression(stat->expression1);
+        if (inner->exp_class == ExpClass::assignment) {
+            return inlinable_call(dynamic_cast<ExpressionAssignment&>(*inner).assign_exp, caller);
+        }
+        used = false;
+        return inlinable_call(inner, caller);
+    }
+
+    // the blocks nested in stat (but not the bodies already inlined)
+    void inline_nested_calls(std::shared_ptr<Function> caller, std::shared_ptr<Statement> stat) {
+        if (stat->statement_type == "compound") {
+            inline_calls(caller, stat->items);
+        } else if (stat->statement_type != "inline") {
+            for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+                inline_nested_calls(caller, child);
+            });
+        }
+    }
+
+    void inline_calls(std::shared_ptr<Function> caller, std::list<std::shared_ptr<BlockItem>>& items) {
+        for (auto item = items.begin(); item != items.end(); item++) {
+            bool used;
+            auto call = call_site(*item, caller, used);
+            if (!call) {
+                if ((*item)->item_type == "statement") {
+                    inline_nested_calls(caller, (*item)->statement);
+                }
+                continue;
+            }
+
+            auto callee = functions[call->id];
+            std::string result = "inline." + std::to_string(inlined++);
+            auto rename = [&](std::string id) {
+                return result + "." + id;
+            };
+
+            auto body = std::shared_ptr<Statement>(new Statement);
+            body->statement_type = "inline";
+            for (auto callee_item: callee->items) {
+                body->items.push_back(clone_block_item(callee_item));
+            }
+            rename_variables(body, rename);
+
+            // the arguments (still in the caller's names) initialise the renamed parameters
+            auto arg = call->args.rbegin();
+            for (auto param = callee->params.rbegin(); param != callee->params.rend(); param++, arg++) {
+                body->items.push_front(temporary_declaration(rename(param->second), **arg));
+            }
+            for_each_statement(body, [&](std::shared_ptr<Statement> stat) {
+                if (stat->statement_type == "return") {
+                    stat->statement_type = "inline_return";
+                    if (used) {
+                        stat->expression1 = build_expression({"r", "=", "e"}, {{"e", stat->expression1}});
+                        dynamic_cast<ExpressionAssignment&>(*wrapper_at(stat->expression1, ExpClass::assignment)).assign_id = result;
+                    }
+                }
+            });
+
+            if (used) {
+                items.insert(item, variable_declaration(result));
+                items.insert(item, statement_item(body));
+                replace_expression(*call, *wrapper_at(variable_expression(result), ExpClass::postfix));
+            } else {
+                *item = statement_item(body);
+            }
+            count_optimisation(caller->id, "calls inlined");
+            note_optimisation(caller->id, "inlined call to " + callee->id);
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// dead code elimination
+
+bool can_complete(std::shared_ptr<Statement> stat);
+
+// whether control can run off the end of a list of block items
+bool items_can_complete(std::list<std::shared_ptr<BlockItem>>& items) {
+    for (auto item: items) {
+        if (item->item_type == "statement" && !can_complete(item->statement)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// whether stat contains a break out of the loop it belongs to (not one of a nested loop)
+bool breaks_out(std::shared_ptr<Statement> stat) {
+    if (stat->statement_type == "break") {
+        return true;
+    } else if (stat->statement_type.find("for") == 0 || stat->statement_type == "while" || stat->statement_type == "do") {
+        return false;
+    }
+    bool found = false;
+    for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+        found = found || breaks_out(child);
+    });
+    return found;
+}
+
+// whether control can reach the statement after stat. Loops only end when their condition can
+// be false or their body breaks out, and return, break and continue never fall through.
+bool can_complete(std::shared_ptr<Statement> stat) {
+    int value;
+    auto type = stat->statement_type;
+    if (type == "return" || type == "break" || type == "continue" || type == "inline_return" ||
+        type == "tail_call") {
+        return false;
+    } else if (type == "inline") {
+        return true;
+    } else if (type == "conditional") {
+        return can_complete(stat->statement1) || can_complete(stat->statement2);
+    } else if (type == "compound") {
+        return items_can_complete(stat->items);
+    } else if (type.find("for") == 0) {
+        return !(constant_value(*stat->expression2, value) && value) || breaks_out(stat->statement1);
+    } else if (type == "while" || type == "do") {
+        return !(constant_value(*stat->expression1, value) && value) || breaks_out(stat->statement1);
+    }
+    return true;
+}
+
+// Removes code that cannot run or whose results are never used, working on the structured
+// AST: without goto every block is reached only through its enclosing statement, so this is
+// reachability over the control flow graph without building one.
+//  - statements after return, break or continue, and after loops that never exit
+//  - if/while/for with constant conditions, keeping only the branch that is taken
+//  - stores to locals that are never read, and side-effect free expression statements
+//  - declarations of locals that are no longer mentioned
+// Functions whose every path returns are marked so codegen leaves out the fall-through epilogue.
+class DeadCodeEliminator {
+    public:
+    DeadCodeEliminator(std::shared_ptr<Function> function): function(function) {}
+
+    void run() {
+        for (auto item: function->items) {
+            if (item->item_type == "statement") {
+                remove_unreachable(item->statement);
+            }
+        }
+        truncate_unreachable(function->items);
+
+        for (auto param: function->params) {
+            declared.insert(param.second);
+        }
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            declared.insert(decl->var_id);
+        });
+
+        // removing a store can leave the variables it used unread, so repeat until nothing changes
+        for (int round=0; round<8; round++) {
+            collect_reads();
+            int removed = 0;
+            for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+                removed += remove_dead_stores(stat);
+            });
+            remove_null_statements(function->items);
+            for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+                remove_null_statements(stat->items);
+            });
+            removed += remove_unused_declarations();
+            if (!removed) {
+                break;
+            }
+        }
+
+        if (!items_can_complete(function->items)) {
+            function->falls_off_end = false;
+            count_optimisation(function->id, "fall-through epilogues removed");
+        }
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    std::set<std::string> declared;     // parameters and locals, whatever their scope
+    std::set<std::string> reads;        // variables whose value is used
+
+    // drops the items following one that cannot complete
+    void truncate_unreachable(std::list<std::shared_ptr<BlockItem>>& items) {
+        for (auto item = items.begin(); item != items.end(); item++) {
+            if ((*item)->item_type == "statement" && !can_complete((*item)->statement)) {
+                int removed = std::distance(std::next(item), items.end());
+                items.erase(std::next(item), items.end());
+                count_optimisation(function->id, "unreachable statements removed", removed);
+                return;
+            }
+        }
+    }
+
+    // folds branches and loops with constant conditions and removes statements after a
+    // return, break or continue, recursively
+    void remove_unreachable(std::shared_ptr<Statement>& stat) {
+        int value;
+        auto type = stat->statement_type;
+        if (type == "conditional" && constant_value(*stat->expression1, value)) {
+            stat = value? stat->statement1: stat->statement2;
+            count_optimisation(function->id, "constant branches folded");
+            remove_unreachable(stat);
+            return;
+        } else if (type == "while" && constant_value(*stat->expression1, value) && !value) {
+            stat = null_statement();
+            count_optimisation(function->id, "constant branches folded");
+            return;
+        } else if (type == "for_expression" && constant_value(*stat->expression2, value) && !value) {
+            // only the init expression runs
+            auto init = stat->expression1;
+            stat = null_statement();
+            stat->expression1 = init;
+            count_optimisation(function->id, "constant branches folded");
+            return;
+        } else if (type == "for_declaration" && constant_value(*stat->expression2, value) && !value) {
+            // only the init declaration runs, kept in a scope of its own
+            stat->statement_type = "compound";
+            stat->statement1 = nullptr;
+            stat->expression2 = stat->expression3 = nullptr;
+            count_optimisation(function->id, "constant branches folded");
+            return;
+        }
+
+        for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+            remove_unreachable(child);
+        });
+        if (type == "compound" || type == "inline") {
+            truncate_unreachable(stat->items);
+        }
+    }
+
+    // records the variables read by exp, except reads of ignored (the variable a discarded
+    // store assigns to, whose old value only matters if the variable is read elsewhere)
+    void collect_reads(Expression& exp, std::string ignored) {
+        std::string id = "";
+        if (exp.exp_class == ExpClass::postfix) {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+            if (exp_post.exp_type == "variable" || exp_post.exp_type == "postfix") {
+                id = exp_post.id;
+            }
+        } else if (exp.exp_class == ExpClass::assignment) {
+            auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+            if (exp_assign.exp_type == "assignment" && exp_assign.assign_type != "=") {
+                id = exp_assign.assign_id;
+            }
+        } else if (exp.exp_class == ExpClass::unary) {
+            auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+            if (exp_unary.exp_type == "prefix") {
+                id = exp_unary.prefix_id;
+            }
+        }
+        if (id != "" && id != ignored) {
+            reads.insert(id);
+        }
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            collect_reads(*child, ignored);
+        });
+    }
+
+    // reads in a comma expression whose value is discarded: each store at its top level only
+    // reads its own variable for that variable's sake
+    void collect_discarded_reads(std::shared_ptr<ExpressionComma> exp) {
+        if (exp && exp->exp_type != "null") {
+            for (auto expression: exp->expressions) {
+                collect_reads(*expression, stored_variable(expression));
+            }
+        }
+    }
+
+    void collect_reads() {
+        reads.clear();
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            auto type = stat->statement_type;
+            if (type == "expression" || type == "for_expression" || type == "inline_return") {
+                collect_discarded_reads(stat->expression1);
+            } else if (stat->expression1) {
+                collect_reads(*stat->expression1, "");
+            }
+            if (type.find("for") == 0) {
+                collect_reads(*stat->expression2, "");
+                collect_discarded_reads(stat->expression3);
+            }
+        });
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            if (decl->initialised) {
+                collect_reads(*decl->init_exp, "");
+            }
+        });
+    }
+
+    // removes stores to variables that are never read and side-effect free expressions from a
+    // discarded comma expression, keeping the right hand side of a store if it has side effects
+    int remove_discarded(std::shared_ptr<ExpressionComma> exp) {
+        if (!exp || exp->exp_type == "null") {
+            return 0;
+        }
+        int removed = 0;
+        std::list<std::shared_ptr<ExpressionAssignment>> kept;
+        for (auto expression: exp->expressions) {
+            auto variable = stored_variable(expression);
+            if (variable != "" && declared.count(variable) && !reads.count(variable)) {
+                count_optimisation(function->id, "dead stores removed");
+                removed++;
+                auto inner = innermost_expression(expression);
+                if (inner->exp_class == ExpClass::assignment) {
+                    auto rhs = dynamic_cast<ExpressionAssignment&>(*inner).assign_exp;
+                    if (has_side_effects(*rhs)) {
+                        kept.push_back(rhs);
+                    }
+                }
+            } else if (!has_side_effects(*expression)) {
+                count_optimisation(function->id, "unused pure expressions removed");
+                removed++;
+            } else {
+                kept.push_back(expression);
+            }
+        }
+        exp->expressions = kept;
+        if (kept.empty()) {
+            exp->exp_type = "null";
+        }
+        return removed;
+    }
+
+    int remove_dead_stores(std::shared_ptr<Statement> stat) {
+        int removed = 0;
+        auto type = stat->statement_type;
+        if (type == "expression" || type == "for_expression" || type == "inline_return") {
+            removed += remove_discarded(stat->expression1);
+        }
+        if (type.find("for") == 0) {
+            removed += remove_discarded(stat->expression3);
+        }
+        return removed;
+    }
+
+    // drops empty statements from a block; they generate no code but keep the tree small
+    void remove_null_statements(std::list<std::shared_ptr<BlockItem>>& items) {
+        items.remove_if([](std::shared_ptr<BlockItem> item) {
+            return item->item_type == "statement" && is_null_statement(item->statement);
+        });
+    }
+
+    // removes declarations of locals that are no longer mentioned anywhere, keeping initialisers
+    // with side effects as expression statements (the declaration in a for loop header stays)
+    int remove_unused_declarations() {
+        std::set<std::string> references;
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+                if (exp) collect_variables(*exp, references);
+            }
+        });
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            if (decl->initialised) {
+                collect_variables(*decl->init_exp, references);
+            }
+        });
+
+        int removed = remove_unused_declarations(function->items, references);
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            if (stat->statement_type == "compound" || stat->statement_type == "inline") {
+                removed += remove_unused_declarations(stat->items, references);
+            }
+        });
+        return removed;
+    }
+
+    int remove_unused_declarations(std::list<std::shared_ptr<BlockItem>>& items, std::set<std::string>& references) {
+        int removed = 0;
+        std::list<std::shared_ptr<BlockItem>> kept;
+        for (auto item: items) {
+            if (item->item_type == "statement") {
+                kept.push_back(item);
+                continue;
+            }
+            auto& declarations = item->declaration_list->declarations;
+            std::list<std::shared_ptr<BlockItem>> initialisers;
+            for (auto decl = declarations.begin(); decl != declarations.end();) {
+                if (references.count((*decl)->var_id)) {
+                    decl++;
+                    continue;
+                }
+                if ((*decl)->initialised && has_side_effects(*(*decl)->init_exp)) {
+                    initialisers.push_back(statement_item(expression_statement((*decl)->init_exp)));
+                }
+                decl = declarations.erase(decl);
+                count_optimisation(function->id, "unused variables removed");
+                removed++;
+            }
+            // initialisers run in declaration order, so an emptied declaration is replaced by them
+            // and a partly removed one keeps its place with them after it
+            if (!declarations.empty()) {
+                kept.push_back(item);
+            }
+            kept.insert(kept.end(), initialisers.begin(), initialisers.end());
+        }
+        items = kept;
+        return removed;
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// store forwarding
+
+// the number of times each variable's value is read in exp (compound assignments, ++ and --
+// read the variable they write)
+void count_reads(Expression& exp, std::map<std::string, int>& reads) {
+    if (exp.exp_class == ExpClass::postfix) {
+        auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+        if (exp_post.exp_type == "variable" || exp_post.exp_type == "postfix") {
+            reads[exp_post.id]++;
+        }
+    } else if (exp.exp_class == ExpClass::assignment) {
+        auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+        if (exp_assign.exp_type == "assignment" && exp_assign.assign_type != "=") {
+            reads[exp_assign.assign_id]++;
+        }
+    } else if (exp.exp_class == ExpClass::unary) {
+        auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+        if (exp_unary.exp_type == "prefix") {
+            reads[exp_unary.prefix_id]++;
+        }
+    }
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        count_reads(*child, reads);
+    });
+}
+
+// every expression directly in item: a statement's own expressions (not those of the
+// statements nested in it) or a declaration's initialisers
+void for_each_item_expression(std::shared_ptr<BlockItem> item, std::function<void(std::shared_ptr<ExpressionComma>)> comma_fn,
+                              std::function<void(std::shared_ptr<ExpressionAssignment>)> init_fn) {
+    if (item->item_type == "statement") {
+        for (auto exp: {item->statement->expression1, item->statement->expression2, item->statement->expression3}) {
+            if (exp) comma_fn(exp);
+        }
+    } else {
+        for (auto decl: item->declaration_list->declarations) {
+            if (decl->initialised) init_fn(decl->init_exp);
+        }
+    }
+}
+
+// Forwards stores to the statement after them, where that is the only place their value is
+// read:
+//     int x = a + 1; y = x * 2;   =>   y = (a + 1) * 2;
+// The store is an expression statement x = e or a declaration of x alone, e has no side effects,
+// and the next item in the block is an expression statement, return or declaration that reads x
+// once, writing neither x nor anything e reads. No other read of x (by that name) anywhere in
+// the function means the store is dead once forwarded, so it goes, and x never touches memory.
+// Stores that the straight-line code after them overwrites before reading are removed too:
+//     x = a * b; y = c; x = d;   =>   y = c; x = d;
+// Locals cannot be addressed, so nothing else can read them in between.
+class StoreForwarder {
+    public:
+    StoreForwarder(std::shared_ptr<Function> function): function(function) {}
+
+    void run() {
+        for (auto param: function->params) {
+            declared.insert(param.second);
+        }
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            declared.insert(decl->var_id);
+        });
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+                if (exp) count_reads(*exp, reads);
+                if (exp) collect_mentions(*exp);
+            }
+        });
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            if (decl->initialised) {
+                count_reads(*decl->init_exp, reads);
+                collect_mentions(*decl->init_exp);
+            }
+        });
+
+        forward_in(function->items);
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            if (stat->statement_type == "compound" || stat->statement_type == "inline") {
+                forward_in(stat->items);
+            }
+        });
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    std::set<std::string> declared;             // parameters and locals
+    std::map<std::string, int> reads;           // reads of each variable in the whole function
+    std::map<std::string, int> mentions;        // reads and writes of each variable
+
+    void collect_mentions(Expression& exp) {
+        if (exp.exp_class == ExpClass::postfix) {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+            if (exp_post.exp_type == "variable" || exp_post.exp_type == "postfix") {
+                mentions[exp_post.id]++;
+            }
+        } else if (assigned_variable(exp) != "") {
+            mentions[assigned_variable(exp)]++;
+        }
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            collect_mentions(*child);
+        });
+    }
+
+    // the variable item stores to and the value, if it is x = e alone or int x = e
+    bool is_store(std::shared_ptr<BlockItem> item, std::string& variable, std::shared_ptr<Expression>& value) {
+        if (item->item_type == "declaration") {
+            auto& declarations = item->declaration_list->declarations;
+            if (declarations.size() != 1 || !declarations.front()->initialised) {
+                return false;
+            }
+            variable = declarations.front()->var_id;
+            value = declarations.front()->init_exp;
+            return true;
+        }
+        auto stat = item->statement;
+        if (stat->statement_type != "expression" || stat->expression1->exp_type == "null" ||
+            stat->expression1->expressions.size() != 1) {
+            return false;
+        }
+        auto inner = innermost_expression(stat->expression1);
+        if (inner->exp_class != ExpClass::assignment) {
+            return false;
+        }
+        auto& exp_assign = dynamic_cast<ExpressionAssignment&>(*inner);
+        if (exp_assign.assign_type != "=") {
+            return false;
+        }
+        variable = exp_assign.assign_id;
+        value = exp_assign.assign_exp;
+        return true;
+    }
+
+    // reads of variable in item's own expressions, and whether they write any of written
+    int item_reads(std::shared_ptr<BlockItem> item, std::string variable, std::set<std::string> written, bool& writes) {
+        std::map<std::string, int> item_reads;
+        std::set<std::string> item_writes;
+        auto visit = [&](std::shared_ptr<Expression> exp) {
+            count_reads(*exp, item_reads);
+            collect_assigned_variables(*exp, item_writes);
+        };
+        for_each_item_expression(item, visit, visit);
+        if (item->item_type == "declaration") {
+            for (auto decl: item->declaration_list->declarations) {
+                item_writes.insert(decl->var_id);
+            }
+        }
+        writes = false;
+        for (auto w: item_writes) {
+            writes = writes || written.count(w);
+        }
+        return item_reads[variable];
+    }
+
+    // whether item is straight-line code: an expression statement or a declaration
+    bool is_straight(std::shared_ptr<BlockItem> item) {
+        return item->item_type == "declaration" || item->statement->statement_type == "expression";
+    }
+
+    // replaces the read of variable in exp with a bracketed copy of value
+    bool substitute(Expression& exp, std::string variable, std::shared_ptr<Expression> value) {
+        if (exp.exp_class == ExpClass::postfix) {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+            if (exp_post.exp_type == "variable" && exp_post.id == variable) {
+                replace_expression(exp, *wrapper_at(build_expression({"e"}, {{"e", value}}), ExpClass::postfix));
+                return true;
+            }
+        }
+        bool done = false;
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            done = done || substitute(*child, variable, value);
+        });
+        return done;
+    }
+
+    // removes the store in item, keeping the declaration when something else still writes to it
+    void remove_store(std::list<std::shared_ptr<BlockItem>>& items, std::list<std::shared_ptr<BlockItem>>::iterator item,
+                      std::string variable) {
+        if ((*item)->item_type == "declaration" && mentions[variable] > 0) {
+            auto decl = (*item)->declaration_list->declarations.front();
+            decl->initialised = false;
+            decl->init_exp = nullptr;
+        } else {
+            items.erase(item);
+        }
+    }
+
+    void forward_in(std::list<std::shared_ptr<BlockItem>>& items) {
+        for (auto item = items.begin(); item != items.end();) {
+            std::string variable;
+            std::shared_ptr<Expression> value;
+            auto next = std::next(item);
+            if (!is_store(*item, variable, value) || !declared.count(variable) || has_side_effects(*value) ||
+                next == items.end()) {
+                item = next;
+                continue;
+            }
+            std::set<std::string> operands;
+            collect_variables(*value, operands);
+            operands.insert(variable);
+            std::map<std::string, int> value_reads;
+            count_reads(*value, value_reads);
+
+            bool writes;
+            auto next_type = (*next)->item_type == "statement"? (*next)->statement->statement_type: "declaration";
+            if (reads[variable] == 1 && item_reads(*next, variable, operands, writes) == 1 && !writes &&
+                (next_type == "expression" || next_type == "return" || next_type == "declaration")) {
+                auto forward = [&](std::shared_ptr<Expression> exp) {
+                    substitute(*exp, variable, value);
+                };
+                for_each_item_expression(*next, forward, forward);
+                reads[variable] = 0;
+                mentions[variable] -= (*item)->item_type == "declaration"? 1: 2;
+                remove_store(items, item, variable);
+                count_optimisation(function->id, "stores forwarded to their only load");
+                item = next;
+                continue;
+            }
+
+            // a later store in the straight-line code after it, with no read in between
+            for (auto later = next; later != items.end() && is_straight(*later); later++) {
+                if (item_reads(*later, variable, {}, writes)) {
+                    break;
+                }
+                std::string later_variable;
+                std::shared_ptr<Expression> later_value;
+                if ((*later)->item_type == "statement" && is_store(*later, later_variable, later_value) &&
+                    later_variable == variable) {
+                    for (auto read: value_reads) {
+                        reads[read.first] -= read.second;
+                    }
+                    mentions[variable]--;
+                    if ((*item)->item_type == "declaration") {
+                        mentions[variable]++;   // stays declared, uninitialised
+                    }
+                    remove_store(items, item, variable);
+                    count_optimisation(function->id, "overwritten stores removed");
+                    break;
+                }
+            }
+            item = next;
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// constant propagation
+
+// a op b as the generated code computes it (wrapping, with >> shifting in zeros like shrl), or
+// false for a division or modulo that would trap
+bool fold_operator(std::string op, int a, int b, int& result) {
+    unsigned int ua = a, ub = b;
+    if (op == "+") result = ua + ub;
+    else if (op == "-") result = ua - ub;
+    else if (op == "*") result = ua * ub;
+    else if (op == "/" || op == "%") {
+        if (b == 0 || (a == INT_MIN && b == -1)) {
+            return false;
+        }
+        result = op == "/"? a / b: a % b;
+    }
+    else if (op == "<<") result = ua << (b & 31);
+    else if (op == ">>") result = ua >> (b & 31);
+    else if (op == "&") result = a & b;
+    else if (op == "|") result = a | b;
+    else if (op == "^") result = a ^ b;
+    else if (op == "==") result = a == b;
+    else if (op == "!=") result = a != b;
+    else if (op == "<") result = a < b;
+    else if (op == ">") result = a > b;
+    else if (op == "<=") result = a <= b;
+    else if (op == ">=") result = a >= b;
+    else return false;
+    return true;
+}
+
+// what is known at a point of the function: the locals holding a constant there, and whether
+// control can get there at all
+class ConstantState {
+    public:
+    bool reachable = true;
+    std::map<std::string, int> constants;
+
+    // the state where paths from here and other join: constant only where both agree
+    void meet(ConstantState& other) {
+        if (!other.reachable) {
+            return;
+        } else if (!reachable) {
+            *this = other;
+            return;
+        }
+        for (auto c = constants.begin(); c != constants.end();) {
+            auto o = other.constants.find(c->first);
+            c = o != other.constants.end() && o->second == c->second? std::next(c): constants.erase(c);
+        }
+    }
+
+    bool operator==(const ConstantState& other) const {
+        return reachable == other.reachable && constants == other.constants;
+    }
+};
+
+// Conditional constant propagation over the structured AST. Each statement is interpreted
+// abstractly in source order with the set of locals known to be constant: a branch whose
+// condition is constant is followed alone, otherwise the states out of both arms are met, and a
+// loop is iterated from the optimistic assumption that nothing changes around it until the state
+// at its head stops changing. Reads of a local that is the same constant every time they run are
+// then replaced by it, and side-effect free expressions made of constants folded:
+//     int debug = 0; ... if (debug) {...}   =>   if (0) {...}
+// and dead code elimination deletes the branch and the store. Without goto, the nesting of the
+// statements is the control flow graph and each name declared once is a single variable, so this
+// finds what sparse conditional constant propagation on SSA would without building either;
+// names declared more than once (shadowing) are left alone.
+class ConstantPropagator {
+    public:
+    ConstantPropagator(std::shared_ptr<Function> function): function(function) {}
+
+    void run() {
+        std::set<std::string> declared;
+        auto declare = [&](std::string id) {
+            if (!declared.insert(id).second) {
+                shadowed.insert(id);
+            }
+        };
+        for (auto param: function->params) {
+            declare(param.second);
+        }
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            declare(decl->var_id);
+        });
+
+        ConstantState state;
+        analyse_items(function->items, state);
+
+        recording = false;
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+                if (exp) rewrite(*exp);
+            }
+        });
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            if (decl->initialised) rewrite(*decl->init_exp);
+        });
+    }
+
+    // folds the constant parts of exp on its own, without propagating anything into it
+    void fold(Expression& exp) {
+        recording = false;
+        rewrite(exp);
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    std::set<std::string> shadowed;                 // names declared more than once
+    bool recording = true;                          // off while iterating loops to a fixed point
+    std::map<Expression*, std::pair<bool, int>> reads;  // whether each read is constant, and its value
+    std::vector<ConstantState> breaks, continues;   // states at the breaks and continues of each loop
+    std::vector<ConstantState> inline_exits;        // states at the returns of each inlined body
+
+    bool lookup(ConstantState& state, std::string id, int& value) {
+        auto c = state.constants.find(id);
+        if (c == state.constants.end()) {
+            return false;
+        }
+        value = c->second;
+        return true;
+    }
+
+    void assign(ConstantState& state, std::string id, bool known, int value) {
+        if (known && !shadowed.count(id)) {
+            state.constants[id] = value;
+        } else {
+            state.constants.erase(id);
+        }
+    }
+
+    void record(Expression& exp, bool known, int value) {
+        if (!recording) {
+            return;
+        }
+        if (reads.count(&exp) && reads[&exp] != std::make_pair(known, value)) {
+            known = false;
+        }
+        reads[&exp] = {known, value};
+    }
+
+    // the value of exp if it is constant, updating state with its stores
+    bool evaluate(Expression& exp, ConstantState& state, int& value) {
+        if (!state.reachable) {
+            return false;
+        }
+        if (auto child = singleton_child(exp)) {
+            return evaluate(*child, state, value);
+        }
+        switch (exp.exp_class) {
+            case ExpClass::comma: {
+                bool known = false;
+                for (auto operand: dynamic_cast<ExpressionComma&>(exp).expressions) {
+                    known = evaluate(*operand, state, value);
+                }
+                return known;
+            }
+            case ExpClass::assignment: {
+                auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+                int operand;
+                bool known = evaluate(*exp_assign.assign_exp, state, operand);
+                if (exp_assign.assign_type == "=") {
+                    value = operand;
+                } else {
+                    auto op = exp_assign.assign_type.substr(0, exp_assign.assign_type.size() - 1);
+                    int current;
+                    known = known && lookup(state, exp_assign.assign_id, current) &&
+                            fold_operator(op, current, operand, value);
+                }
+                assign(state, exp_assign.assign_id, known, value);
+                return known;
+            }
+            case ExpClass::conditional: {
+                auto& exp_cond = dynamic_cast<ExpressionConditional&>(exp);
+                int condition;
+                if (evaluate(*exp_cond.condition, state, condition)) {
+                    return condition? evaluate(*exp_cond.exp_true, state, value): evaluate(*exp_cond.exp_false, state, value);
+                }
+                auto false_state = state;
+                int true_value, false_value;
+                bool known = evaluate(*exp_cond.exp_true, state, true_value) &
+                             evaluate(*exp_cond.exp_false, false_state, false_value);
+                state.meet(false_state);
+                value = true_value;
+                return known && state.reachable && true_value == false_value;
+            }
+            case ExpClass::logicor:
+            case ExpClass::logicand: {
+                // codegen evaluates every operand where the value is wanted but stops at the
+                // deciding one in a branch, so the operands after the first may or may not run
+                int deciding = exp.exp_class == ExpClass::logicor;
+                bool known = true;
+                value = !deciding;
+                bool first = true;
+                for_each_child_expression(exp, [&](std::shared_ptr<Expression> operand) {
+                    auto ran = state;
+                    int operand_value;
+                    bool operand_known = evaluate(*operand, ran, operand_value);
+                    if (first) {
+                        state = ran;
+                    } else {
+                        state.meet(ran);
+                    }
+                    first = false;
+                    if (known && value != deciding) {
+                        known = operand_known;
+                        value = operand_known && !operand_value == !deciding? deciding: value;
+                    }
+                });
+                return known;
+            }
+            case ExpClass::unary: {
+                auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+                if (exp_unary.exp_type == "prefix") {
+                    int current;
+                    bool known = lookup(state, exp_unary.prefix_id, current) &&
+                                 fold_operator(exp_unary.unaryop.substr(1), current, 1, value);
+                    assign(state, exp_unary.prefix_id, known, value);
+                    return known;
+                }
+                int operand;
+                if (!evaluate(*exp_unary.unary_exp, state, operand)) {
+                    return false;
+                }
+                value = exp_unary.unaryop == "-"? (int) (0u - (unsigned int) operand):
+                        exp_unary.unaryop == "~"? ~operand: !operand;
+                return true;
+            }
+            case ExpClass::postfix: {
+                auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+                if (exp_post.exp_type == "const_int") {
+                    value = exp_post.value_int;
+                    return true;
+                } else if (exp_post.exp_type == "variable") {
+                    bool known = lookup(state, exp_post.id, value);
+                    record(exp, known, value);
+                    return known;
+                } else if (exp_post.exp_type == "postfix") {
+                    int updated;
+                    bool known = lookup(state, exp_post.id, value) &&
+                                 fold_operator(exp_post.postfix_op.substr(1), value, 1, updated);
+                    assign(state, exp_post.id, known, updated);
+                    return known;
+                }
+                // a call: its arguments are pushed last to first, and it cannot touch our locals
+                for (auto arg = exp_post.args.rbegin(); arg != exp_post.args.rend(); arg++) {
+                    int arg_value;
+                    evaluate(**arg, state, arg_value);
+                }
+                return false;
+            }
+            default: {
+                // the binary operators, applied left to right
+                std::list<std::shared_ptr<Expression>> operands;
+                for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+                    operands.push_back(child);
+                });
+                auto operators = operators_of(exp);
+                bool known = evaluate(*operands.front(), state, value);
+                auto op = operators.begin();
+                for (auto operand = std::next(operands.begin()); operand != operands.end(); operand++, op++) {
+                    int operand_value;
+                    bool operand_known = evaluate(**operand, state, operand_value);
+                    known = known && operand_known && fold_operator(*op, value, operand_value, value);
+                }
+                return known;
+            }
+        }
+    }
+
+    // the value of a loop condition, where an empty one is always true
+    bool evaluate_condition(std::shared_ptr<ExpressionComma> exp, ConstantState& state, int& value) {
+        if (exp->exp_type == "null") {
+            value = 1;
+            return state.reachable;
+        }
+        return evaluate(*exp, state, value);
+    }
+
+    void analyse_items(std::list<std::shared_ptr<BlockItem>>& items, ConstantState& state) {
+        for (auto item: items) {
+            if (item->item_type == "statement") {
+                analyse(item->statement, state);
+                continue;
+            }
+            for (auto decl: item->declaration_list->declarations) {
+                int value = 0;
+                bool known = decl->initialised && evaluate(*decl->init_exp, state, value);
+                assign(state, decl->var_id, known, value);
+            }
+        }
+    }
+
+    void analyse(std::shared_ptr<Statement> stat, ConstantState& state) {
+        if (!stat || !state.reachable) {
+            return;
+        }
+        int value;
+        auto type = stat->statement_type;
+        if (type == "expression") {
+            evaluate(*stat->expression1, state, value);
+        } else if (type == "return" || type == "tail_call") {
+            evaluate(*stat->expression1, state, value);
+            state.reachable = false;
+        } else if (type == "inline_return") {
+            evaluate(*stat->expression1, state, value);
+            inline_exits.back().meet(state);
+            state.reachable = false;
+        } else if (type == "break" || type == "continue") {
+            (type == "break"? breaks: continues).back().meet(state);
+            state.reachable = false;
+        } else if (type == "compound") {
+            analyse_items(stat->items, state);
+        } else if (type == "inline") {
+            inline_exits.push_back(ConstantState());
+            inline_exits.back().reachable = false;
+            analyse_items(stat->items, state);
+            state.meet(inline_exits.back());
+            inline_exits.pop_back();
+        } else if (type == "conditional") {
+            if (evaluate(*stat->expression1, state, value)) {
+                analyse(value? stat->statement1: stat->statement2, state);
+                return;
+            }
+            auto else_state = state;
+            analyse(stat->statement1, state);
+            analyse(stat->statement2, else_state);
+            state.meet(else_state);
+        } else {
+            analyse_loop(stat, state);
+        }
+    }
+
+    // one pass through a loop from the state at its head: returns the state at the end of the
+    // body (where it goes round again) and leaves the state after the loop in exit
+    ConstantState iterate(std::shared_ptr<Statement> stat, ConstantState state, ConstantState& exit) {
+        auto type = stat->statement_type;
+        auto condition = type == "while" || type == "do"? stat->expression1: stat->expression2;
+        breaks.push_back(ConstantState());
+        breaks.back().reachable = false;
+        continues.push_back(breaks.back());
+
+        int value;
+        exit = state;
+        exit.reachable = false;
+        if (type != "do") {
+            bool known = evaluate_condition(condition, state, value);
+            if (!known || !value) {
+                exit = state;
+            }
+            if (known && !value) {
+                state.reachable = false;
+            }
+        }
+        analyse(stat->statement1, state);
+        state.meet(continues.back());
+        if (type == "do") {
+            bool known = evaluate_condition(condition, state, value);
+            if (!known || !value) {
+                exit = state;
+            }
+            if (known && !value) {
+                state.reachable = false;
+            }
+        } else if (type.find("for") == 0) {
+            evaluate(*stat->expression3, state, value);
+        }
+        exit.meet(breaks.back());
+        breaks.pop_back();
+        continues.pop_back();
+        return state;
+    }
+
+    void analyse_loop(std::shared_ptr<Statement> stat, ConstantState& state) {
+        int value;
+        if (stat->statement_type == "for_declaration") {
+            analyse_items(stat->items, state);
+        } else if (stat->statement_type == "for_expression") {
+            evaluate(*stat->expression1, state, value);
+        }
+
+        // the state at the head is what comes in met with what comes round, starting from the
+        // optimistic guess that nothing does. Meeting with the last guess too means constants are
+        // only ever dropped, so this ends.
+        bool outer_recording = recording;
+        recording = false;
+        auto head = state;
+        ConstantState exit;
+        while (true) {
+            auto next = state;
+            auto back = iterate(stat, head, exit);
+            next.meet(back);
+            next.meet(head);
+            if (next == head) {
+                break;
+            }
+            head = next;
+        }
+        recording = outer_recording;
+        if (recording) {
+            iterate(stat, head, exit);
+        }
+        state = exit;
+    }
+
+    // an integer literal in place of exp
+    void replace_with_constant(Expression& exp, int value) {
+        replace_expression(exp, *wrapper_at(constant_expression(value), exp.exp_class));
+    }
+
+    // replaces constant reads in exp and folds what that leaves constant
+    void rewrite(Expression& exp) {
+        if (reads.count(&exp) && reads[&exp].first) {
+            replace_with_constant(exp, reads[&exp].second);
+            count_optimisation(function->id, "constants propagated");
+            return;
+        }
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            rewrite(*child);
+        });
+        int value;
+        ConstantState state;
+        if (exp.exp_class == ExpClass::conditional && !singleton_child(exp)) {
+            auto& exp_cond = dynamic_cast<ExpressionConditional&>(exp);
+            if (!has_side_effects(*exp_cond.condition) && evaluate(*exp_cond.condition, state, value)) {
+                auto taken = value? wrapper_at(build_expression({"e"}, {{"e", exp_cond.exp_true}}), ExpClass::conditional):
+                                    exp_cond.exp_false;
+                replace_expression(exp, *taken);
+                count_optimisation(function->id, "constant branches folded");
+                return;
+            }
+        }
+        if (!singleton_child(exp) && exp.exp_class != ExpClass::postfix && !constant_value(exp, value) &&
+            !has_side_effects(exp) && evaluate(exp, state, value)) {
+            replace_with_constant(exp, value);
+            count_optimisation(function->id, "constant expressions folded");
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// loop-invariant code motion
+
+bool is_loop(std::shared_ptr<Statement> stat) {
+    return stat->statement_type.find("for") == 0 || stat->statement_type == "while" || stat->statement_type == "do";
+}
+
+// variables written or declared anywhere in stat
+std::set<std::string> modified_variables(std::shared_ptr<Statement> stat) {
+    std::set<std::string> modified;
+    for_each_statement(stat, [&](std::shared_ptr<Statement> inner) {
+        for (auto exp: {inner->expression1, inner->expression2, inner->expression3}) {
+            if (exp) collect_assigned_variables(*exp, modified);
+        }
+        for (auto item: inner->items) {
+            if (item->item_type == "declaration") {
+                for (auto decl: item->declaration_list->declarations) {
+                    modified.insert(decl->var_id);
+                    if (decl->initialised) collect_assigned_variables(*decl->init_exp, modified);
+                }
+            }
+        }
+    });
+    return modified;
+}
+
+// whether exp computes something, rather than passing a single operand through or
+// naming a variable or constant
+bool is_computation(Expression& exp) {
+    if (singleton_child(exp)) {
+        return false;
+    }
+    switch (exp.exp_class) {
+        case ExpClass::comma:
+        case ExpClass::assignment:
+        case ExpClass::postfix:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// whether exp is a comparison or logical operator, which codegen fuses into the jump when it
+// is a branch condition (so hoisting or reusing it would save nothing)
+bool is_test(Expression& exp) {
+    switch (exp.exp_class) {
+        case ExpClass::logicor:
+        case ExpClass::logicand:
+        case ExpClass::equality:
+        case ExpClass::relational:
+            return true;
+        case ExpClass::unary:
+            return dynamic_cast<ExpressionUnary&>(exp).unaryop == "!";
+        default:
+            return false;
+    }
+}
+
+// Hoists computations whose operands no loop iteration changes into temporaries declared just
+// before the loop. Loops are the for, while and do statements (the only back edges there are
+// without goto); a loop's preheader is a new block wrapping it:
+//     for (i = 0; i < n*4; i++) body   =>   { int t = n*4; for (i = 0; i < t; i++) body }
+// Only side-effect free expressions that cannot trap are moved, since the preheader also runs
+// when the loop body never does. Calls are never moved, and the variables an expression reads
+// must not be written or declared anywhere in the loop, its init clause included (so the loop
+// itself is left whole). Locals are not addressable and there are no globals, so a call inside
+// the loop cannot change them.
+class LoopInvariantCodeMotion {
+    public:
+    LoopInvariantCodeMotion(std::shared_ptr<Function> function): function(function) {}
+
+    void run() {
+        for (auto item: function->items) {
+            if (item->item_type == "statement") {
+                hoist_from_loops(item->statement);
+            }
+        }
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    int temporaries = 0;
+    std::set<std::string> modified;                     // variables written or declared in the current loop
+    std::list<std::shared_ptr<BlockItem>> preheader;    // declarations of the current loop's temporaries
+
+    // outer loops first, so an expression invariant in several nested loops leaves all of them
+    void hoist_from_loops(std::shared_ptr<Statement>& stat) {
+        if (!is_loop(stat)) {
+            for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+                hoist_from_loops(child);
+            });
+            return;
+        }
+
+        auto loop = stat;
+        modified = modified_variables(loop);
+        preheader.clear();
+        for_each_statement(loop, [&](std::shared_ptr<Statement> inner) {
+            auto type = inner->statement_type;
+            if (inner == loop && type == "for_expression") {
+                // the init clause runs once, before the loop (as does a declaration, below)
+            } else if (inner->expression1) {
+                hoist_from(*inner->expression1, type == "conditional" || type == "while" || type == "do");
+            }
+            if (type.find("for") == 0) {
+                hoist_from(*inner->expression2, true);
+                hoist_from(*inner->expression3);
+            }
+            for (auto item: inner->items) {
+                if (item->item_type == "declaration" && inner != loop) {
+                    for (auto decl: item->declaration_list->declarations) {
+                        if (decl->initialised) hoist_from(*decl->init_exp);
+                    }
+                }
+            }
+        });
+
+        if (!preheader.empty()) {
+            stat = std::shared_ptr<Statement>(new Statement);
+            stat->statement_type = "compound";
+            stat->items = preheader;
+            stat->items.push_back(statement_item(loop));
+        }
+
+        hoist_from_loops(loop->statement1);
+    }
+
+    bool is_invariant(Expression& exp) {
+        if (has_side_effects(exp) || can_trap(exp)) {
+            return false;
+        }
+        std::set<std::string> variables;
+        collect_variables(exp, variables);
+        for (auto variable: variables) {
+            if (modified.count(variable)) {
+                return false;
+            }
+        }
+        return !variables.empty();          // constant expressions are left to be folded
+    }
+
+    // replaces the largest invariant computations in exp by temporaries. In a branch condition
+    // only the operands of the tests it is made of are candidates.
+    void hoist_from(Expression& exp, bool condition = false) {
+        if (condition && (singleton_child(exp) || is_test(exp))) {
+            bool logical = exp.exp_class == ExpClass::logicor || exp.exp_class == ExpClass::logicand ||
+                           exp.exp_class == ExpClass::unary || singleton_child(exp);
+            for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+                hoist_from(*child, logical);
+            });
+            return;
+        }
+        if (is_computation(exp) && is_invariant(exp)) {
+            std::string temporary = "licm." + std::to_string(temporaries++);
+            auto hoisted = copy_expression(exp);
+            replace_expression(exp, *wrapper_at(variable_expression(temporary), exp.exp_class));
+            preheader.push_back(temporary_declaration(temporary, *hoisted));
+            count_optimisation(function->id, "loop invariants hoisted");
+            return;
+        }
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            hoist_from(*child);
+        });
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// common subexpression elimination
+
+// a string that is the same for expressions computing the same thing the same way, whatever
+// brackets and single-operand wrappers they are written with
+std::string expression_key(Expression& exp) {
+    if (auto child = singleton_child(exp)) {
+        return expression_key(*child);
+    }
+    int value;
+    if (constant_value(exp, value)) {
+        return std::to_string(value);
+    }
+    std::list<std::string> operators;
+    std::string key = "";
+    switch (exp.exp_class) {
+        case ExpClass::equality: operators = dynamic_cast<ExpressionEquality&>(exp).operators; break;
+        case ExpClass::relational: operators = dynamic_cast<ExpressionRelational&>(exp).operators; break;
+        case ExpClass::shift: operators = dynamic_cast<ExpressionShift&>(exp).operators; break;
+        case ExpClass::add: operators = dynamic_cast<ExpressionAdd&>(exp).operators; break;
+        case ExpClass::mult: operators = dynamic_cast<ExpressionMult&>(exp).operators; break;
+        case ExpClass::unary: {
+            auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+            key = exp_unary.unaryop + exp_unary.prefix_id;
+            break;
+        }
+        case ExpClass::postfix: {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+            key = exp_post.exp_type + " " + exp_post.id + exp_post.postfix_op;
+            break;
+        }
+        case ExpClass::assignment: {
+            auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+            key = exp_assign.assign_id + exp_assign.assign_type;
+            break;
+        }
+        default:
+            break;
+    }
+    key = std::to_string((int) exp.exp_class) + key + "(";
+    auto op = operators.begin();
+    bool first = true;
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        if (!first) {
+            key += op != operators.end()? " " + *op++ + " ": ", ";
+        }
+        key += expression_key(*child);
+        first = false;
+    });
+    return key + ")";
+}
+
+// a computation that has been evaluated on every path to where the scan has got to, with its
+// operands unchanged since
+class AvailableExpression {
+    public:
+    Expression* first;              // the occurrence that computed it
+    std::string temporary;          // where first saves its value, once something reuses it
+    std::set<std::string> variables;
+};
+
+// Replaces computations that were already made, with the same operands, on every path to them
+// by a temporary the first one saves its value to:
+//     x = (a+b)*(a+b);   =>   x = (cse.0 = a+b)*cse.0;
+// The function is scanned in evaluation order with a table of the computations available so far.
+// A branch (an if arm, a loop, the right of && and ||, an arm of ?:) is scanned with a copy of
+// the table that is dropped afterwards, except for what the branch made unavailable, so only
+// computations that dominate a reuse are reused. Writing a variable, or declaring one that
+// shadows it, makes every computation using it unavailable, and before a loop so does any write
+// anywhere in the loop. Calls change no locals (they cannot be addressed and there are no
+// globals), so only the ++, -- and assignments in their arguments count. Comparisons and
+// logical operators are left alone for codegen to fuse into jumps, and the arguments of a call
+// are scanned right to left, the order codegen evaluates them in. The temporaries are declared
+// at the top of the function.
+class CommonSubexpressionEliminator {
+    public:
+    CommonSubexpressionEliminator(std::shared_ptr<Function> function): function(function) {}
+
+    void run() {
+        scan_items(function->items);
+        for (int i=temporaries-1; i>=0; i--) {
+            function->items.push_front(variable_declaration("cse." + std::to_string(i)));
+        }
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    int temporaries = 0;
+    std::map<std::string, std::shared_ptr<AvailableExpression>> available;
+
+    void kill(std::string variable) {
+        for (auto entry = available.begin(); entry != available.end();) {
+            if (entry->second->variables.count(variable)) {
+                entry = available.erase(entry);
+            } else {
+                entry++;
+            }
+        }
+    }
+
+    // scans code that may or may not run: afterwards only what was available before and still
+    // is remains so
+    void scan_branch(std::function<void()> scan) {
+        auto before = available;
+        scan();
+        auto after = available;
+        available.clear();
+        for (auto entry: before) {
+            if (after.count(entry.first) && after[entry.first] == entry.second) {
+                available.insert(entry);
+            }
+        }
+    }
+
+    bool is_candidate(Expression& exp) {
+        std::set<std::string> variables;
+        collect_variables(exp, variables);
+        return is_computation(exp) && !is_test(exp) && exp.exp_class != ExpClass::unary &&
+               !has_side_effects(exp) && !variables.empty();
+    }
+
+    void reuse(Expression& exp, std::shared_ptr<AvailableExpression> entry) {
+        if (entry->temporary == "") {
+            // the first occurrence becomes (t = first)
+            entry->temporary = "cse." + std::to_string(temporaries++);
+            auto saved = build_expression({"(", "t", "=", "e", ")"}, {});
+            auto assignment = std::static_pointer_cast<ExpressionAssignment>(innermost_expression(saved));
+            assignment->assign_id = entry->temporary;
+            replace_expression(*wrapper_at(assignment->assign_exp, entry->first->exp_class), *copy_expression(*entry->first));
+            replace_expression(*entry->first, *wrapper_at(saved, entry->first->exp_class));
+        }
+        replace_expression(exp, *wrapper_at(variable_expression(entry->temporary), exp.exp_class));
+        count_optimisation(function->id, "common subexpressions eliminated");
+    }
+
+    void scan(Expression& exp) {
+        std::string key;
+        std::shared_ptr<AvailableExpression> entry;
+        if (is_candidate(exp)) {
+            key = expression_key(exp);
+            if (available.count(key)) {
+                reuse(exp, available[key]);
+                return;
+            }
+            entry = std::shared_ptr<AvailableExpression>(new AvailableExpression);
+            entry->first = &exp;
+            collect_variables(exp, entry->variables);
+        }
+
+        std::vector<std::shared_ptr<Expression>> children;
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            children.push_back(child);
+        });
+        if (exp.exp_class == ExpClass::postfix && dynamic_cast<ExpressionPostfix&>(exp).exp_type == "function_call") {
+            std::reverse(children.begin(), children.end());
+        }
+        // everything after the first operand of && and ||, and both arms of ?:, may not run
+        bool branches = exp.exp_class == ExpClass::logicor || exp.exp_class == ExpClass::logicand ||
+                        (exp.exp_class == ExpClass::conditional &&
+                         dynamic_cast<ExpressionConditional&>(exp).exp_type == "conditional");
+        for (int i=0; i<children.size(); i++) {
+            if (branches && i > 0) {
+                scan_branch([&]() { scan(*children[i]); });
+            } else {
+                scan(*children[i]);
+            }
+        }
+
+        auto written = assigned_variable(exp);
+        if (written != "") {
+            kill(written);
+        }
+        if (entry) {
+            available[key] = entry;
+        }
+    }
+
+    void scan_items(std::list<std::shared_ptr<BlockItem>>& items) {
+        for (auto item: items) {
+            if (item->item_type == "statement") {
+                scan(item->statement);
+                continue;
+            }
+            for (auto decl: item->declaration_list->declarations) {
+                if (decl->initialised) {
+                    scan(*decl->init_exp);
+                }
+                kill(decl->var_id);
+            }
+        }
+    }
+
+    void scan(std::shared_ptr<Statement> stat) {
+        auto type = stat->statement_type;
+        if (type == "conditional") {
+            scan(*stat->expression1);
+            auto before = available;
+            scan_branch([&]() { scan(stat->statement1); });
+            auto after_then = available;
+            available = before;
+            scan_branch([&]() { scan(stat->statement2); });
+            for (auto entry = available.begin(); entry != available.end();) {
+                if (after_then.count(entry->first)) {
+                    entry++;
+                } else {
+                    entry = available.erase(entry);
+                }
+            }
+        } else if (type == "compound" || type == "inline") {
+            scan_branch([&]() { scan_items(stat->items); });
+        } else if (is_loop(stat)) {
+            if (type == "for_declaration") {
+                scan_items(stat->items);
+            } else if (type == "for_expression") {
+                scan(*stat->expression1);
+            }
+            for (auto variable: modified_variables(stat)) {
+                kill(variable);
+            }
+            if (type == "do") {
+                scan_branch([&]() { scan(stat->statement1); });
+                scan_branch([&]() { scan(*stat->expression1); });
+            } else if (type == "while") {
+                scan_branch([&]() { scan(*stat->expression1); });
+                scan_branch([&]() { scan(stat->statement1); });
+            } else {
+                scan_branch([&]() { scan(*stat->expression2); });
+                scan_branch([&]() { scan(stat->statement1); });
+                scan_branch([&]() { scan(*stat->expression3); });
+            }
+        } else if (stat->expression1) {
+            scan(*stat->expression1);
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// algebraic simplification
+
+// A rewrite from one expression to a simpler one that computes the same value, both written in
+// source with spaces between the tokens. In the pattern, x, y and z match any expression (the
+// same one each time they appear), c and d match only constants, and literals match themselves.
+// Where a variable appears a different number of times in the replacement, whatever it matched
+// is dropped or repeated, so the rule only applies when that has no side effects.
+class RewriteRule {
+    public:
+    RewriteRule(std::string pattern, std::string replacement, bool truth_only = false):
+        pattern(pattern), replacement(replacement), truth_only(truth_only) {}
+
+    std::string pattern;
+    std::string replacement;
+    bool truth_only;        // only where nothing but whether the value is zero matters
+
+    std::list<std::string> replacement_tokens() {
+        return split(replacement);
+    }
+
+    // the pattern's top node (past the wrappers parsing it leaves around it)
+    std::shared_ptr<Expression> pattern_expression() {
+        if (!parsed_pattern) {
+            auto tokens = split(pattern);
+            tokens.push_back(";");
+            parsed_pattern = parse_expression_comma(tokens);
+            while (auto child = singleton_child(*parsed_pattern)) {
+                parsed_pattern = child;
+            }
+        }
+        return parsed_pattern;
+    }
+
+    // whether dropping or repeating what variable matched could change the program
+    bool needs_pure(std::string variable) {
+        auto pattern_tokens = split(pattern);
+        auto tokens = replacement_tokens();
+        return std::count(pattern_tokens.begin(), pattern_tokens.end(), variable) !=
+               std::count(tokens.begin(), tokens.end(), variable);
+    }
+
+    private:
+    std::shared_ptr<Expression> parsed_pattern;
+
+    static std::list<std::string> split(std::string source) {
+        std::list<std::string> tokens;
+        std::istringstream words(source);
+        std::string token;
+        while (words >> token) {
+            tokens.push_back(token);
+        }
+        return tokens;
+    }
+};
+
+// the rules, tried in order at each expression. >> is logical here as it is in the generated code.
+std::vector<RewriteRule> rewrite_rules = {
+    {"x + 0", "x"},
+    {"0 + x", "x"},
+    {"x - 0", "x"},
+    {"0 - x", "- x"},
+    {"x - x", "0"},
+    {"x * 1", "x"},
+    {"1 * x", "x"},
+    {"x * 0", "0"},
+    {"0 * x", "0"},
+    {"x * - 1", "- x"},
+    {"x / 1", "x"},
+    {"x / - 1", "- x"},
+    {"x % 1", "0"},
+    {"x << 0", "x"},
+    {"x >> 0", "x"},
+    {"( x << c ) >> c", "x & ( - 1 >> c )"},
+    {"x & 0", "0"},
+    {"x & - 1", "x"},
+    {"x & x", "x"},
+    {"x | 0", "x"},
+    {"x | - 1", "- 1"},
+    {"x | x", "x"},
+    {"x ^ 0", "x"},
+    {"x ^ x", "0"},
+    {"x == x", "1"},
+    {"x != x", "0"},
+    {"x < x", "0"},
+    {"x > x", "0"},
+    {"x <= x", "1"},
+    {"x >= x", "1"},
+    {"- - x", "x"},
+    {"~ ~ x", "x"},
+    {"! ( x == y )", "x != y"},
+    {"! ( x != y )", "x == y"},
+    {"! ( x < y )", "x >= y"},
+    {"! ( x > y )", "x <= y"},
+    {"! ( x <= y )", "x > y"},
+    {"! ( x >= y )", "x < y"},
+    {"! ! x", "x", true},
+    {"x != 0", "x", true},
+    {"! ! x", "x != 0"},
+};
+
+// Rewrites expressions by the table of rules above, innermost first, folding any constants a
+// replacement puts together:
+//     y = (x << 2) >> 2;   =>   y = x & 1073741823;
+//     if (!!(a - a + b)) ...   =>   if (b) ...
+// A binary pattern also matches the leading operands of a longer chain, so x + 0 rewrites
+// a + b + 0 + c to (a + b) + c. Each rule's uses are counted in the report.
+class AlgebraicSimplifier {
+    public:
+    AlgebraicSimplifier(std::shared_ptr<Function> function): function(function) {}
+
+    void run() {
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            auto type = stat->statement_type;
+            auto condition = type == "conditional" || type == "while" || type == "do"? stat->expression1:
+                             type.find("for") == 0? stat->expression2: nullptr;
+            for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+                if (exp) simplify(*exp, exp == condition);
+            }
+        });
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            if (decl->initialised) simplify(*decl->init_exp, false);
+        });
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    typedef std::map<std::string, std::shared_ptr<Expression>> Bindings;
+
+    void simplify(Expression& exp, bool truth_only) {
+        if (auto child = singleton_child(exp)) {
+            simplify(*child, truth_only);
+            return;
+        }
+        // only the truth of the operands of !, && and || and of a condition matters
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            bool child_truth = exp.exp_class == ExpClass::logicor || exp.exp_class == ExpClass::logicand ||
+                               (exp.exp_class == ExpClass::unary && dynamic_cast<ExpressionUnary&>(exp).unaryop == "!") ||
+                               (exp.exp_class == ExpClass::conditional &&
+                                (child == dynamic_cast<ExpressionConditional&>(exp).condition? true: truth_only));
+            simplify(*child, child_truth);
+        });
+        // the replacement may simplify further (every rule leaves fewer operators or simpler ones)
+        if (rewrite_once(exp, truth_only)) {
+            simplify(exp, truth_only);
+        }
+    }
+
+    bool rewrite_once(Expression& exp, bool truth_only) {
+        for (auto& rule: rewrite_rules) {
+            if ((!rule.truth_only || truth_only) && apply(rule, exp)) {
+                count_optimisation(function->id, "simplified " + rule.pattern + " to " + rule.replacement);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // an expression of exp's class made of the first count of its operands
+    std::shared_ptr<Expression> leading_operands(Expression& exp, int count) {
+        std::list<std::string> tokens;
+        std::map<std::string, std::shared_ptr<Expression>> operands;
+        auto operators = operators_of(exp);
+        auto op = operators.begin();
+        int i = 0;
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            if (i < count) {
+                if (i > 0) tokens.push_back(*op++);
+                tokens.push_back("e" + std::to_string(i));
+                operands["e" + std::to_string(i)] = child;
+            }
+            i++;
+        });
+        return wrapper_at(build_expression(tokens, operands), exp.exp_class);
+    }
+
+    // rewrites exp, or the longest run of its leading operands, by rule. The pattern is matched
+    // against exp in place: only a run bound to a variable is built, once the rest has matched.
+    bool apply(RewriteRule& rule, Expression& exp) {
+        auto pattern = rule.pattern_expression();
+        if (pattern->exp_class != exp.exp_class) {
+            return false;
+        }
+        std::vector<std::shared_ptr<Expression>> operands;
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            operands.push_back(child);
+        });
+        int pattern_operands = operators_of(*pattern).size() + 1;
+        for (int count = operands.size(); count >= pattern_operands; count--) {
+            Bindings bindings;
+            if (!match_operation(*pattern, exp, count, bindings)) {
+                if (pattern_operands == 1) {
+                    return false;   // not a chain that has shorter runs to try
+                }
+                continue;
+            }
+            for (auto binding: bindings) {
+                if (rule.needs_pure(binding.first) && has_side_effects(*binding.second)) {
+                    return false;
+                }
+            }
+            // the replacement, followed by the operands it did not cover, bracketed so that it can
+            // stand in for exp whatever its class
+            auto tokens = rule.replacement_tokens();
+            tokens.push_front("(");
+            tokens.push_back(")");
+            auto operators = operators_of(exp);
+            auto op = std::next(operators.begin(), count - 1);
+            for (int i = count; i < (int) operands.size(); i++) {
+                tokens.push_back(*op++);
+                tokens.push_back("rest" + std::to_string(i));
+                bindings["rest" + std::to_string(i)] = operands[i];
+            }
+            tokens.push_front("(");
+            tokens.push_back(")");
+            auto result = build_expression(tokens, bindings);
+            ConstantPropagator(function).fold(*result);
+            replace_expression(exp, *wrapper_at(result, exp.exp_class));
+            return true;
+        }
+        return false;
+    }
+
+    // whether target has the shape of pattern, binding the pattern's variables to what they matched
+    bool match(Expression& pattern, std::shared_ptr<Expression> target, Bindings& bindings) {
+        while (auto child = singleton_child(*target)) {
+            target = child;
+        }
+        int value, target_value;
+        if (constant_value(pattern, value)) {
+            return constant_value(*target, target_value) && target_value == value;
+        }
+        if (auto child = singleton_child(pattern)) {
+            return match(*child, target, bindings);
+        }
+        if (pattern.exp_class == ExpClass::postfix) {
+            auto id = dynamic_cast<ExpressionPostfix&>(pattern).id;
+            if ((id == "c" || id == "d") && !constant_value(*target, target_value)) {
+                return false;
+            } else if (bindings.count(id)) {
+                return expression_key(*bindings[id]) == expression_key(*target);
+            }
+            bindings[id] = target;
+            return true;
+        }
+        int count = 0;
+        for_each_child_expression(*target, [&](std::shared_ptr<Expression> child) {
+            count++;
+        });
+        return match_operation(pattern, *target, count, bindings);
+    }
+
+    // whether the first count operands of target (all of them, or a leading run of a chain) have
+    // the shape of pattern, an operation
+    bool match_operation(Expression& pattern, Expression& target, int count, Bindings& bindings) {
+        if (pattern.exp_class != target.exp_class) {
+            return false;
+        }
+        if (pattern.exp_class == ExpClass::unary) {
+            auto& pattern_unary = dynamic_cast<ExpressionUnary&>(pattern);
+            auto& target_unary = dynamic_cast<ExpressionUnary&>(target);
+            return target_unary.exp_type == "unary_op" && target_unary.unaryop == pattern_unary.unaryop &&
+                   match(*pattern_unary.unary_exp, target_unary.unary_exp, bindings);
+        }
+
+        // a binary chain: a longer target's extra leading operands go to the pattern's first
+        std::vector<std::shared_ptr<Expression>> pattern_operands, target_operands;
+        for_each_child_expression(pattern, [&](std::shared_ptr<Expression> child) {
+            pattern_operands.push_back(child);
+        });
+        for_each_child_expression(target, [&](std::shared_ptr<Expression> child) {
+            target_operands.push_back(child);
+        });
+        auto pattern_operators = operators_of(pattern);
+        if (pattern_operators.empty() || count < (int) pattern_operands.size()) {
+            return false;
+        }
+        int extra = count - pattern_operands.size();
+        auto target_operators = operators_of(target);
+        auto first = std::next(target_operators.begin(), extra);
+        if (!std::equal(pattern_operators.begin(), pattern_operators.end(), first)) {
+            return false;
+        }
+        // the first operand last, so that a run it takes is only built when the rest matched
+        for (size_t i=1; i<pattern_operands.size(); i++) {
+            if (!match(*pattern_operands[i], target_operands[extra + i], bindings)) {
+                return false;
+            }
+        }
+        if (!extra) {
+            return match(*pattern_operands.front(), target_operands.front(), bindings);
+        }
+        return match_run(*pattern_operands.front(), target, extra + 1, bindings);
+    }
+
+    // whether the leading run of count (at least 2) operands of target has the shape of pattern
+    bool match_run(Expression& pattern, Expression& target, int count, Bindings& bindings) {
+        Expression* inner = &pattern;
+        while (auto child = singleton_child(*inner)) {
+            inner = child.get();
+        }
+        int value;
+        if (constant_value(*inner, value)) {
+            return false;           // a run of operators is no literal
+        } else if (inner->exp_class == ExpClass::postfix) {
+            return match(*inner, leading_operands(target, count), bindings);
+        }
+        return match_operation(*inner, target, count, bindings);
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// reassociation
+
+// Regroups chains of an associative operator: + and - together, * alone, and each of &, | and ^.
+// Brackets around a chain of the same operator are opened up (distributing a minus) and the
+// constants in it are folded into one at the end, where codegen can use it as an immediate:
+//     x + 1 + y + 2   =>   x + y + 3
+//     a - (b - 4) * 1 - 3   =>   a - b + 1
+// The other operands keep their order, so side effects happen as they did, and integer
+// arithmetic wraps, so the result is exact. With options.balance_chains set, chains of at least
+// that many operands (all added, or all under one operator) are also rebuilt as balanced trees,
+//     a + b + c + d   =>   (a + b) + (c + d)
+// whose halves do not depend on each other. Codegen still evaluates everything through eax and
+// the stack, so that only pays off for a backend that keeps the halves in registers, and is off
+// by default.
+class Reassociator {
+    public:
+    Reassociator(std::shared_ptr<Function> function, OptimiserOptions options): function(function), options(options) {}
+
+    void run() {
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            for (auto exp: {stat->expression1, stat->expression2, stat->expression3}) {
+                if (exp) reassociate(*exp);
+            }
+        });
+        for_each_declaration(function, [&](std::shared_ptr<Declaration> decl) {
+            if (decl->initialised) reassociate(*decl->init_exp);
+        });
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    OptimiserOptions options;
+
+    class Term {
+        public:
+        bool negated;
+        std::shared_ptr<Expression> operand;
+    };
+
+    // the operator a chain of exp's class is made of, or "" if it is not associative
+    std::string chain_operator(Expression& exp) {
+        auto operators = operators_of(exp);
+        if (exp.exp_class == ExpClass::add) {
+            return "+";
+        } else if (exp.exp_class == ExpClass::mult) {
+            return std::count(operators.begin(), operators.end(), "*") == (int) operators.size()? "*": "";
+        } else if (exp.exp_class == ExpClass::bitwiseor || exp.exp_class == ExpClass::bitwisexor ||
+                   exp.exp_class == ExpClass::bitwiseand) {
+            return operators.front();
+        }
+        return "";
+    }
+
+    // the operands of chain, folding its constants into constant
+    void collect(Expression& chain, bool negated, std::string op, std::vector<Term>& terms, int& constant, int& constants) {
+        auto operators = operators_of(chain);
+        auto before = operators.begin();
+        bool first = true;
+        for_each_child_expression(chain, [&](std::shared_ptr<Expression> child) {
+            bool sign = negated != (!first && *before++ == "-");
+            first = false;
+            auto inner = child;
+            while (auto next = singleton_child(*inner)) {
+                inner = next;
+            }
+            int value;
+            if (constant_value(*child, value)) {
+                fold_operator(op == "+" && sign? "-": op, constant, value, constant);
+                constants++;
+            } else if (inner->exp_class == chain.exp_class && chain_operator(*inner) == op) {
+                collect(*inner, sign, op, terms, constant, constants);
+            } else {
+                terms.push_back({sign, child});
+            }
+        });
+    }
+
+    // tokens for the terms from first to last, built as a balanced tree
+    std::list<std::string> balanced(int first, int last, std::string op) {
+        if (first == last) {
+            return {"t" + std::to_string(first)};
+        }
+        int middle = (first + last)/2;
+        auto tokens = balanced(first, middle, op);
+        auto right = balanced(middle + 1, last, op);
+        tokens.push_front("(");
+        tokens.push_back(op);
+        tokens.insert(tokens.end(), right.begin(), right.end());
+        tokens.push_back(")");
+        return tokens;
+    }
+
+    void reassociate(Expression& exp) {
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            reassociate(*child);
+        });
+        auto op = singleton_child(exp)? "": chain_operator(exp);
+        if (op == "") {
+            return;
+        }
+        int identity = op == "*"? 1: op == "&"? -1: 0;
+        int constant = identity;
+        int constants = 0;
+        std::vector<Term> terms;
+        collect(exp, false, op, terms, constant, constants);
+
+        std::list<std::string> tokens;
+        std::map<std::string, std::shared_ptr<Expression>> operands;
+        for (size_t i=0; i<terms.size(); i++) {
+            operands["t" + std::to_string(i)] = terms[i].operand;
+        }
+        bool all_positive = std::none_of(terms.begin(), terms.end(), [](Term& term) { return term.negated; });
+        bool balance = options.balance_chains > 1 && (int) terms.size() >= options.balance_chains && all_positive;
+        if (balance) {
+            tokens = balanced(0, terms.size() - 1, op);
+        } else if (op == "+" && !terms.empty() && terms.front().negated && constant != 0) {
+            // k - a ..., rather than negating a
+            tokens.push_back("k");
+        }
+        for (size_t i=0; i<terms.size() && !balance; i++) {
+            if (!tokens.empty()) {
+                tokens.push_back(terms[i].negated? "-": op);
+            } else if (terms[i].negated) {
+                tokens.push_back("-");
+            }
+            tokens.push_back("t" + std::to_string(i));
+        }
+        if (tokens.empty()) {
+            tokens.push_back("k");
+        } else if (tokens.front() != "k" && constant != identity) {
+            // x - 5 rather than x + -5
+            bool subtract = op == "+" && constant < 0 && constant != INT_MIN;
+            tokens.push_back(subtract? "-": op);
+            tokens.push_back("k");
+            constant = subtract? -constant: constant;
+        }
+        operands["k"] = constant_expression(constant);
+        tokens.push_front("(");
+        tokens.push_back(")");
+
+        auto result = build_expression(tokens, operands);
+        if (expression_key(*result) == expression_key(exp)) {
+            return;
+        }
+        replace_expression(exp, *wrapper_at(result, exp.exp_class));
+        count_optimisation(function->id, balance? "chains balanced": "chains reassociated");
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// loop unrolling
+
+// whether stat contains a break or continue belonging to the loop around it
+bool contains_loop_jump(std::shared_ptr<Statement> stat) {
+    if (stat->statement_type == "break" || stat->statement_type == "continue") {
+        return true;
+    } else if (is_loop(stat)) {
+        return false;
+    }
+    bool found = false;
+    for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+        found = found || contains_loop_jump(child);
+    });
+    return found;
+}
+
+// a for loop counting an induction variable up or down to a bound no iteration changes:
+//     for (init; i op bound; i += step) body
+class CountedLoop {
+    public:
+    std::string variable;
+    std::string op;                     // <, <=, > or >=
+    std::shared_ptr<Expression> bound;
+    int step;                           // positive when op is < or <=, negative otherwise
+    bool constant_start = false;        // whether init sets variable to start
+    int start;
+};
+
+// Unrolls innermost counted for loops. A loop with a constant trip count of at most
+// full_unroll_trips is replaced by that many copies of its body (each followed by the step, so
+// the variable ends up with the same value). Otherwise the body is copied unroll_factor times
+// into a loop that runs while all of the copies' iterations are in range, followed by the
+// original loop for the remaining trips:
+//     for (init; i < n; i++) body   =>   { init; for (; i < n - 3; i++) { body; i++; body; i++;
+//                                          body; i++; body } for (; i < n; i++) body }
+// For a bound that is not constant, n - 3 goes into a temporary, and the unrolled loop is skipped
+// if computing it overflowed. Unrolled bodies are kept within unroll_budget operations.
+class LoopUnroller {
+    public:
+    LoopUnroller(std::shared_ptr<Function> function, OptimiserOptions options): function(function), options(options) {}
+
+    void run() {
+        for (auto item: function->items) {
+            if (item->item_type == "statement") {
+                unroll_loops(item->statement);
+            }
+        }
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    OptimiserOptions options;
+    int temporaries = 0;
+
+    void unroll_loops(std::shared_ptr<Statement>& stat) {
+        bool innermost = is_loop(stat);
+        for_each_child_statement(stat, [&](std::shared_ptr<Statement>& child) {
+            for_each_statement(child, [&](std::shared_ptr<Statement> inner) {
+                innermost = innermost && !is_loop(inner);
+            });
+            unroll_loops(child);
+        });
+
+        CountedLoop loop;
+        if (innermost && stat->statement_type.find("for") == 0 && analyse(stat, loop)) {
+            unroll(stat, loop);
+        }
+    }
+
+    // the induction variable and step of a post expression like i++, --i or i += 4
+    bool analyse_step(std::shared_ptr<ExpressionComma> post, CountedLoop& loop) {
+        if (post->exp_type == "null" || post->expressions.size() != 1) {
+            return false;
+        }
+        auto inner = innermost_expression(post);
+        int value;
+        if (inner->exp_class == ExpClass::postfix) {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(*inner);
+            loop.step = exp_post.postfix_op == "++"? 1: -1;
+        } else if (inner->exp_class == ExpClass::unary) {
+            auto& exp_unary = dynamic_cast<ExpressionUnary&>(*inner);
+            loop.step = exp_unary.unaryop == "++"? 1: -1;
+        } else if (inner->exp_class == ExpClass::assignment) {
+            auto& exp_assign = dynamic_cast<ExpressionAssignment&>(*inner);
+            if ((exp_assign.assign_type != "+=" && exp_assign.assign_type != "-=") ||
+                !constant_value(*exp_assign.assign_exp, value) || value == 0 || value > (1 << 20) || value < -(1 << 20)) {
+                return false;
+            }
+            loop.step = exp_assign.assign_type == "+="? value: -value;
+        }
+        loop.variable = stored_variable(inner);
+        return loop.variable != "";
+    }
+
+    bool analyse(std::shared_ptr<Statement> stat, CountedLoop& loop) {
+        if (!analyse_step(stat->expression3, loop)) {
+            return false;
+        }
+
+        auto cond = innermost_expression(stat->expression2);
+        if (cond->exp_class != ExpClass::relational) {
+            return false;
+        }
+        auto& exp_rel = dynamic_cast<ExpressionRelational&>(*cond);
+        if (exp_rel.expressions.size() != 2) {
+            return false;
+        }
+        auto left = innermost_expression(exp_rel.expressions.front());
+        if (left->exp_class != ExpClass::postfix ||
+            dynamic_cast<ExpressionPostfix&>(*left).exp_type != "variable" ||
+            dynamic_cast<ExpressionPostfix&>(*left).id != loop.variable) {
+            return false;
+        }
+        loop.op = exp_rel.operators.front();
+        loop.bound = exp_rel.expressions.back();
+        if ((loop.step > 0) != (loop.op == "<" || loop.op == "<=")) {
+            return false;
+        }
+
+        // the body may neither change the variable or the bound nor leave early
+        auto modified = modified_variables(stat->statement1);
+        std::set<std::string> bound_variables;
+        collect_variables(*loop.bound, bound_variables);
+        if (modified.count(loop.variable) || bound_variables.count(loop.variable) ||
+            has_side_effects(*loop.bound) || can_trap(*loop.bound) || contains_loop_jump(stat->statement1)) {
+            return false;
+        }
+        for (auto variable: bound_variables) {
+            if (modified.count(variable)) {
+                return false;
+            }
+        }
+
+        std::shared_ptr<Expression> init;
+        if (stat->statement_type == "for_declaration") {
+            auto& declarations = stat->items.front()->declaration_list->declarations;
+            if (declarations.size() == 1 && declarations.front()->var_id == loop.variable && declarations.front()->initialised) {
+                init = declarations.front()->init_exp;
+            }
+        } else if (stat->expression1->exp_type != "null" && stat->expression1->expressions.size() == 1) {
+            auto inner = innermost_expression(stat->expression1);
+            if (inner->exp_class == ExpClass::assignment) {
+                auto& exp_assign = dynamic_cast<ExpressionAssignment&>(*inner);
+                if (exp_assign.exp_type == "assignment" && exp_assign.assign_type == "=" && exp_assign.assign_id == loop.variable) {
+                    init = exp_assign.assign_exp;
+                }
+            }
+        }
+        loop.constant_start = init && constant_value(*init, loop.start);
+        return true;
+    }
+
+    // the number of iterations, or -1 if it is not a compile-time constant (or the variable
+    // would overflow getting there)
+    long long trip_count(CountedLoop& loop) {
+        int bound;
+        if (!loop.constant_start || !constant_value(*loop.bound, bound)) {
+            return -1;
+        }
+        long long start = loop.start, step = loop.step, trips;
+        if (step > 0) {
+            long long last = loop.op == "<"? bound - 1LL: bound;
+            trips = start > last? 0: (last - start)/step + 1;
+        } else {
+            long long last = loop.op == ">"? bound + 1LL: bound;
+            trips = start < last? 0: (start - last)/(-step) + 1;
+        }
+        long long end = start + trips*step;
+        return end < INT_MIN || end > INT_MAX? -1: trips;
+    }
+
+    void unroll(std::shared_ptr<Statement>& stat, CountedLoop& loop) {
+        int copy_size = statement_size(stat->statement1) + expression_size(*stat->expression3);
+        long long trips = trip_count(loop);
+
+        auto block = std::shared_ptr<Statement>(new Statement);
+        block->statement_type = "compound";
+        if (stat->statement_type == "for_declaration") {
+            block->items.push_back(stat->items.front());
+        } else {
+            block->items.push_back(statement_item(comma_statement(stat->expression1)));
+        }
+
+        if (trips >= 0 && trips <= options.full_unroll_trips && trips*copy_size <= options.unroll_budget) {
+            for (int trip=0; trip<trips; trip++) {
+                block->items.push_back(statement_item(clone_statement(stat->statement1)));
+                block->items.push_back(statement_item(comma_statement(clone_as(stat->expression3))));
+            }
+            stat = block;
+            count_optimisation(function->id, "loops fully unrolled");
+            return;
+        }
+
+        int factor = std::min(options.unroll_factor, options.unroll_budget/std::max(copy_size, 1));
+        if (factor < 2) {
+            return;
+        }
+
+        // the unrolled loop runs while the variable is within (factor - 1) steps of the bound
+        long long distance = (long long) (factor - 1)*loop.step;
+        std::shared_ptr<Expression> limit;
+        std::shared_ptr<Statement> guard;
+        int bound;
+        if (constant_value(*loop.bound, bound)) {
+            if (bound - distance < INT_MIN || bound - distance > INT_MAX) {
+                return;
+            }
+            limit = constant_expression(bound - distance);
+        } else {
+            std::string temporary = "unroll." + std::to_string(temporaries++);
+            auto difference = build_expression({"b", "-", "d"}, {{"b", loop.bound}, {"d", constant_expression(distance)}});
+            block->items.push_back(temporary_declaration(temporary, *difference));
+            limit = variable_expression(temporary);
+
+            guard = std::shared_ptr<Statement>(new Statement);
+            guard->statement_type = "conditional";
+            guard->expression1 = build_expression({"l", loop.step > 0? "<": ">", "b"}, {{"l", limit}, {"b", loop.bound}});
+            guard->statement2 = null_statement();
+        }
+
+        auto unrolled = std::shared_ptr<Statement>(new Statement);
+        unrolled->statement_type = "for_expression";
+        unrolled->expression1 = null_statement()->expression1;
+        unrolled->expression2 = build_expression({"i", loop.op, "l"}, {{"i", variable_expression(loop.variable)}, {"l", limit}});
+        unrolled->expression3 = clone_as(stat->expression3);
+        unrolled->statement1 = std::shared_ptr<Statement>(new Statement);
+        unrolled->statement1->statement_type = "compound";
+        for (int copy=0; copy<factor; copy++) {
+            if (copy > 0) {
+                unrolled->statement1->items.push_back(statement_item(comma_statement(clone_as(stat->expression3))));
+            }
+            unrolled->statement1->items.push_back(statement_item(clone_statement(stat->statement1)));
+        }
+        if (guard) {
+            guard->statement1 = unrolled;
+            block->items.push_back(statement_item(guard));
+        } else {
+            block->items.push_back(statement_item(unrolled));
+        }
+
+        // the original loop, without its init clause, runs the remaining trips
+        stat->statement_type = "for_expression";
+        stat->items.clear();
+        stat->expression1 = null_statement()->expression1;
+        block->items.push_back(statement_item(stat));
+        stat = block;
+        count_optimisation(function->id, "loops unrolled");
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// tail calls
+
+// Turns each return of a call into a tail_call, which overwrites this function's arguments with
+// the callee's and jumps to it instead of calling it, so it returns straight to this function's
+// caller. A call back to the function itself becomes a jump to just past the prologue, so tail
+// recursion runs as a loop in constant stack. The callee's arguments have to fit where this
+// function's were pushed, so it can take at most as many, and it has to have been declared already
+// (codegen checks the arguments of ordinary calls against that declaration).
+class TailCallOptimiser {
+    public:
+    TailCallOptimiser(std::shared_ptr<Function> function, std::map<std::string, std::shared_ptr<Function>>& declared):
+        function(function), declared(declared) {}
+
+    void run() {
+        for_each_statement(function, [&](std::shared_ptr<Statement> stat) {
+            if (stat->statement_type != "return") {
+                return;
+            }
+            auto inner = innermost_expression(stat->expression1);
+            if (inner->exp_class != ExpClass::postfix) {
+                return;
+            }
+            auto& call = dynamic_cast<ExpressionPostfix&>(*inner);
+            if (call.exp_type != "function_call" || !declared.count(call.id) || call.args.size() != declared[call.id]->params.size() ||
+                call.args.size() > function->params.size()) {
+                return;
+            }
+            stat->statement_type = "tail_call";
+            if (call.id == function->id) {
+                function->tail_recursive = true;
+                count_optimisation(function->id, "tail recursive calls turned into jumps");
+            } else {
+                count_optimisation(function->id, "tail calls");
+            }
+        });
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    std::map<std::string, std::shared_ptr<Function>>& declared;    // functions declared so far
+};
+
+// ---------------------------------------------------------------------------------------------
+// verification
+
+// Checks the invariants the passes rely on and codegen expects, so a pass that breaks the tree
+// is caught straight after it runs rather than showing up as wrong code: each expression is of
+// the type its class says, with all its operands; every variable is declared in an enclosing
+// scope before it is used; break and continue are in loops, and inline_return in inlined bodies.
+class Verifier {
+    public:
+    Verifier(std::shared_ptr<Function> function, std::string after): function(function), after(after) {}
+
+    void run() {
+        scopes.push_back({});
+        for (auto param: function->params) {
+            scopes.back().insert(param.second);
+        }
+        verify_items(function->items);
+    }
+
+    private:
+    std::shared_ptr<Function> function;
+    std::string after;                          // the pass that has just run
+    std::vector<std::set<std::string>> scopes;
+    int loops = 0;                              // loops around the statement being checked
+    int inlines = 0;                            // inlined bodies around it
+
+    void fail(std::string problem) {
+        throw std::runtime_error("internal error: " + problem + " in " + function->id + " after " + after + "\n");
+    }
+
+    void use(std::string id) {
+        for (auto& scope: scopes) {
+            if (scope.count(id)) {
+                return;
+            }
+        }
+        fail("use of undeclared variable " + id);
+    }
+
+    template <class T>
+    T& as(Expression& exp) {
+        auto typed = dynamic_cast<T*>(&exp);
+        if (!typed) {
+            fail("expression of the wrong type for its class");
+        }
+        return *typed;
+    }
+
+    // that a list of operands joined by operators has one more operand than operators
+    template <class T>
+    void verify_chain(Expression& exp) {
+        auto& chain = as<T>(exp);
+        if (chain.expressions.size() != chain.operators.size() + 1) {
+            fail("operators and operands that do not match up");
+        }
+    }
+
+    void verify_expression(Expression& exp) {
+        switch (exp.exp_class) {
+            case ExpClass::comma: {
+                auto& exp_comma = as<ExpressionComma>(exp);
+                if (exp_comma.expressions.empty() != (exp_comma.exp_type == "null")) {
+                    fail("comma expression with the wrong number of operands");
+                }
+                break;
+            }
+            case ExpClass::assignment: {
+                auto& exp_assign = as<ExpressionAssignment>(exp);
+                if (exp_assign.exp_type == "assignment") {
+                    use(exp_assign.assign_id);
+                }
+                break;
+            }
+            case ExpClass::conditional: as<ExpressionConditional>(exp); break;
+            case ExpClass::logicor: as<ExpressionLogicOr>(exp); break;
+            case ExpClass::logicand: as<ExpressionLogicAnd>(exp); break;
+            case ExpClass::bitwiseor: as<ExpressionBitwiseOr>(exp); break;
+            case ExpClass::bitwisexor: as<ExpressionBitwiseXor>(exp); break;
+            case ExpClass::bitwiseand: as<ExpressionBitwiseAnd>(exp); break;
+            case ExpClass::equality: verify_chain<ExpressionEquality>(exp); break;
+            case ExpClass::relational: verify_chain<ExpressionRelational>(exp); break;
+            case ExpClass::shift: verify_chain<ExpressionShift>(exp); break;
+            case ExpClass::add: verify_chain<ExpressionAdd>(exp); break;
+            case ExpClass::mult: verify_chain<ExpressionMult>(exp); break;
+            case ExpClass::unary: {
+                auto& exp_unary = as<ExpressionUnary>(exp);
+                if (exp_unary.exp_type == "prefix") {
+                    use(exp_unary.prefix_id);
+                }
+                break;
+            }
+            case ExpClass::postfix: {
+                auto& exp_post = as<ExpressionPostfix>(exp);
+                if (exp_post.exp_type == "variable" || exp_post.exp_type == "postfix") {
+                    use(exp_post.id);
+                }
+                break;
+            }
+        }
+        bool empty = true;
+        for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+            if (!child) {
+                fail("missing operand");
+            }
+            verify_expression(*child);
+            empty = false;
+        });
+        if (empty && exp.exp_class != ExpClass::postfix && exp.exp_class != ExpClass::comma &&
+            !(exp.exp_class == ExpClass::unary && dynamic_cast<ExpressionUnary&>(exp).exp_type == "prefix")) {
+            fail("expression without operands");
+        }
+    }
+
+    void verify_expression(std::shared_ptr<ExpressionComma> exp, std::string type) {
+        if (!exp) {
+            fail(type + " statement without its expression");
+        }
+        verify_expression(*exp);
+    }
+
+    void verify_items(std::list<std::shared_ptr<BlockItem>>& items) {
+        for (auto item: items) {
+            if (item->item_type == "statement") {
+                verify_statement(item->statement);
+                continue;
+            }
+            for (auto decl: item->declaration_list->declarations) {
+                if (decl->initialised) {
+                    verify_expression(*decl->init_exp);
+                }
+                scopes.back().insert(decl->var_id);
+            }
+        }
+    }
+
+    void verify_statement(std::shared_ptr<Statement> stat) {
+        if (!stat) {
+            fail("missing statement");
+        }
+        auto type = stat->statement_type;
+        if (type == "expression" || type == "return" || type == "tail_call") {
+            verify_expression(stat->expression1, type);
+        } else if (type == "inline_return") {
+            if (!inlines) {
+                fail("inline_return outside an inlined body");
+            }
+            verify_expression(stat->expression1, type);
+        } else if (type == "break" || type == "continue") {
+            if (!loops) {
+                fail(type + " outside a loop");
+            }
+        } else if (type == "conditional") {
+            verify_expression(stat->expression1, type);
+            verify_statement(stat->statement1);
+            verify_statement(stat->statement2);
+        } else if (type == "compound" || type == "inline") {
+            inlines += type == "inline";
+            scopes.push_back({});
+            verify_items(stat->items);
+            scopes.pop_back();
+            inlines -= type == "inline";
+        } else if (type == "while" || type == "do" || type.find("for") == 0) {
+            scopes.push_back({});
+            if (type == "for_declaration") {
+                verify_items(stat->items);
+            }
+            if (type.find("for") == 0) {
+                if (type == "for_expression") {
+                    verify_expression(stat->expression1, type);
+                }
+                verify_expression(stat->expression2, type);
+                verify_expression(stat->expression3, type);
+            } else {
+                verify_expression(stat->expression1, type);
+            }
+            loops++;
+            verify_statement(stat->statement1);
+            loops--;
+            scopes.pop_back();
+        } else {
+            fail("unknown statement type " + type);
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------------------------
+// pass manager
+
+// what a function pass gets besides the function
+class PassContext {
+    public:
+    OptimiserOptions options;
+    std::map<std::string, std::shared_ptr<Function>> declared;  // functions declared up to this one
+};
+
+// one step of the pipeline: either a pass over the whole program or one run on each function
+class OptimiserPass {
+    public:
+    std::string name;           // as in -fno-<name>
+    int level;                  // the lowest -O level that runs it
+    std::function<void(Program&, OptimiserOptions&)> run_program;
+    std::function<void(std::shared_ptr<Function>, PassContext&)> run_function;
+};
+
+// the pipeline, in the order the passes run
+std::vector<OptimiserPass> optimiser_passes = {
+    {"inline", 2, [](Program& prog, OptimiserOptions& options) {
+        if (options.inline_limit > 0) Inliner(prog, options).run();
+    }, nullptr},
+    {"constprop", 1, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        ConstantPropagator(function).run();
+    }},
+    {"simplify", 1, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        AlgebraicSimplifier(function).run();
+    }},
+    {"reassociate", 2, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        Reassociator(function, context.options).run();
+    }},
+    {"forward-stores", 1, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        StoreForwarder(function).run();
+    }},
+    {"dce", 1, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        DeadCodeEliminator(function).run();
+    }},
+    {"licm", 2, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        LoopInvariantCodeMotion(function).run();
+    }},
+    {"cse", 2, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        CommonSubexpressionEliminator(function).run();
+    }},
+    {"unroll", 2, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        LoopUnroller(function, context.options).run();
+    }},
+    {"tail-calls", 1, nullptr, [](std::shared_ptr<Function> function, PassContext& context) {
+        TailCallOptimiser(function, context.declared).run();
+    }},
+};
+
+bool is_optimiser_pass(std::string name) {
+    return std::any_of(optimiser_passes.begin(), optimiser_passes.end(), [&](OptimiserPass& pass) {
+        return pass.name == name;
+    });
+}
+
+void verify_program(Program& prog, std::string after) {
+    for (auto function: prog.functions) {
+        if (function->defined) {
+            Verifier(function, after).run();
+        }
+    }
+}
+
+// Runs each pass the options enable over the program, timing it (for -ftime-report) and, in
+// builds without NDEBUG, verifying the tree after it.
+void optimise_program(Program& prog, OptimiserOptions options = OptimiserOptions()) {
+    for (auto& pass: optimiser_passes) {
+        if (!options.runs(pass.name, pass.level)) {
+            continue;
+        }
+        if (pass.run_program) {
+            PhaseTimer timer(pass.name, pass_timings, "optimise");
+            pass.run_program(prog, options);
+        } else {
+            PassContext context;
+            context.options = options;
+            for (auto function: prog.functions) {
+                if (!context.declared.count(function->id)) {
+                    context.declared[function->id] = function;
+                }
+                if (function->defined) {
+                    PhaseTimer timer(pass.name, pass_timings, "optimise");
+                    pass.run_function(function, context);
+                }
+            }
+        }
+#ifndef NDEBUG
+        verify_program(prog, pass.name);
+#endif
+    }
+}
+
+// number of instructions in each function of an assembly listing
+std::map<std::string, int> count_instructions(std::string assembly) {
+    std::map<std::string, int> counts;
+    std::string function = "";
+    std::istringstream lines(assembly);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.find(".globl _") == 0) {
+            function = line.substr(std::string(".globl _").size());
+        } else if (line.find("    ") == 0 && function != "") {
+            counts[function]++;
+        }
+    }
+    return counts;
+}
+
+// what the passes did to each function, with the instruction counts of the code generated
+// before and after them
+std::string optimisation_report_text(std::string unoptimised, std::string optimised) {
+    auto before = count_instructions(unoptimised);
+    auto after = count_instructions(optimised);
+    std::string out = "optimisation report\n";
+    for (auto function: before) {
+        out += (boost::format("  %s: %d -> %d instructions (%d eliminated)\n")
+                % function.first % function.second % after[function.first]
+                % (function.second - after[function.first])).str();
+        for (auto counter: optimisation_stats[function.first]) {
+            out += (boost::format("    %-36s %d\n") % counter.first % counter.second).str();
+        }
+        for (auto note: optimisation_notes[function.first]) {
+            out += "    " + note + "\n";
+        }
+    }
+    return out;
+}
+
+#define OPTIMISER
+#endif
@@ -31,11 +31,14 @@
 //                   | <const>
 
 #ifndef PARSER
+#include <functional>
 #include <list>
 #include <regex>
 #include <set>
 #include <string>
 
+#include "timing.hpp"
+
 #ifdef JSON
 #include "json.hpp"
 
@@ -44,6 +47,12 @@ using json = nlohmann::json;
 
 // set of reserved keywords
 std::set<std::string> keywords = {"return", "int", "float", "while", "do", "for", "break", "continue", "if", "else"};
+
+// token patterns, built once rather than on every match
+const std::regex identifier_regex("[A-Za-z]\\w*");
+const std::regex underscore_identifier_regex("[A-Za-z_]\\w*");
+const std::regex unary_operator_regex("[!~-]");
+
 std::map<std::string, int> types = {    // types, each given a rank (lower number -> higher rank)
     {"float", 0},
     {"int", 1}
@@ -131,6 +140,8 @@ class Function {
     std::string id;
     std::list<std::pair<std::string, std::string>> params;
     bool defined = false;
+    bool falls_off_end = true;  // cleared by the optimiser when every path ends in a return
+    bool tail_recursive = false;    // set by the optimiser when a return jumps back to the start
     std::list<std::shared_ptr<BlockItem>> items;
 };
 
@@ -280,7 +291,9 @@ Program parse_program(std::list<std::string> tokens) {
     Program prog;
 
     while (tokens.size() > 0) {
+        TraceScope trace("parse", "parse");
         prog.functions.push_back(std::shared_ptr<Function>(parse_function(tokens)));
+        trace.rename("parse " + prog.functions.back()->id);
     }
 
     return prog;
@@ -308,7 +321,7 @@ std::shared_ptr<Function> parse_function(std::list<std::string>& tokens) {
     }
     fun->return_type = tokens.front();
     tokens.pop_front();
-    if (!std::regex_match(tokens.front(), std::regex("[A-Za-z_]\\w*"))) {
+    if (!std::regex_match(tokens.front(), underscore_identifier_regex)) {
         throw std::runtime_error("invalid function identifier: " + tokens.front() + "\n");
     }
     fun->id = tokens.front();
@@ -340,7 +353,7 @@ std::shared_ptr<Function> parse_function(std::list<std::string>& tokens) {
                 continue;
             }
             if (keywords.count(tokens.front()) || 
-                !std::regex_match(tokens.front(), std::regex("[A-Za-z_]\\w*"))) {
+                !std::regex_match(tokens.front(), underscore_identifier_regex)) {
                 throw std::runtime_error("invalid identifier: " + tokens.front() + "\n");
             }
             param.second = tokens.front();
@@ -463,7 +476,7 @@ json jsonify_declaration_list(std::shared_ptr<DeclarationList>& declist) {
 std::shared_ptr<Declaration> parse_declaration(std::list<std::string>& tokens) {
     auto decl = std::shared_ptr<Declaration>(new Declaration);
 
-    if (!(std::regex_match(tokens.front(), std::regex("[A-Za-z]\\w*")))) {
+    if (!(std::regex_match(tokens.front(), identifier_regex))) {
         throw std::runtime_error("invalid identifier: " + tokens.front() + "\n");
     }
     decl->var_id = tokens.front();
@@ -734,7 +747,7 @@ std::shared_ptr<ExpressionAssignment> parse_expression_assignment(std::list<std:
     auto exp = std::shared_ptr<ExpressionAssignment>(new ExpressionAssignment);
     exp->exp_class = ExpClass::assignment;
 
-    if (std::regex_match(tokens.front(), std::regex("[A-Za-z_]\\w*"))) {
+    if (std::regex_match(tokens.front(), underscore_identifier_regex)) {
         if (keywords.count(tokens.front())) {
             throw std::runtime_error("expected identifier (got '" + tokens.front() + "' )\n");
         }
@@ -1227,7 +1240,7 @@ std::shared_ptr<ExpressionUnary> parse_expression_unary(std::list<std::string>&
     auto exp = std::shared_ptr<ExpressionUnary>(new ExpressionUnary);
     exp->exp_class = ExpClass::unary;
 
-    if (std::regex_match(tokens.front(), std::regex("[!~-]"))) {
+    if (std::regex_match(tokens.front(), unary_operator_regex)) {
         exp->exp_type = "unary_op";
         exp->unaryop = tokens.front();
         tokens.pop_front();
@@ -1238,7 +1251,7 @@ std::shared_ptr<ExpressionUnary> parse_expression_unary(std::list<std::string>&
         tokens.pop_front();
 
         if (keywords.count(tokens.front()) ||
-            !std::regex_match(tokens.front(), std::regex("[A-Za-z]\\w*"))) {
+            !std::regex_match(tokens.front(), identifier_regex)) {
             throw std::runtime_error("invalid identifier: " + tokens.front() + "\n");
         }
         exp->prefix_id = tokens.front();
@@ -1288,7 +1301,7 @@ std::shared_ptr<ExpressionPostfix> parse_expression_postfix(std::list<std::strin
         tokens.pop_front();
 
         return exp;
-    } else if (std::regex_match(tokens.front(), std::regex("[A-Za-z]\\w*"))) {
+    } else if (std::regex_match(tokens.front(), identifier_regex)) {
         if (keywords.count(tokens.front())) {
             throw std::runtime_error("invalid identifier: " + tokens.front() + "\n");
         }
@@ -1389,5 +1402,178 @@ json jsonify_expression_postfix(std::shared_ptr<ExpressionPostfix>& exp) {
 }
 #endif
 
+// calls fn on each direct subexpression of exp, in source order
+void for_each_child_expression(Expression& exp, std::function<void(std::shared_ptr<Expression>)> fn) {
+    switch (exp.exp_class) {
+        case ExpClass::comma:
+            for (auto child: dynamic_cast<ExpressionComma&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::assignment: {
+            auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+            if (exp_assign.exp_type == "assignment") {
+                fn(exp_assign.assign_exp);
+            } else {
+                fn(exp_assign.expression);
+            }
+            break;
+        }
+        case ExpClass::conditional: {
+            auto& exp_cond = dynamic_cast<ExpressionConditional&>(exp);
+            fn(exp_cond.condition);
+            if (exp_cond.exp_type == "conditional") {
+                fn(exp_cond.exp_true);
+                fn(exp_cond.exp_false);
+            }
+            break;
+        }
+        case ExpClass::logicor:
+            for (auto child: dynamic_cast<ExpressionLogicOr&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::logicand:
+            for (auto child: dynamic_cast<ExpressionLogicAnd&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::bitwiseor:
+            for (auto child: dynamic_cast<ExpressionBitwiseOr&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::bitwisexor:
+            for (auto child: dynamic_cast<ExpressionBitwiseXor&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::bitwiseand:
+            for (auto child: dynamic_cast<ExpressionBitwiseAnd&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::equality:
+            for (auto child: dynamic_cast<ExpressionEquality&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::relational:
+            for (auto child: dynamic_cast<ExpressionRelational&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::shift:
+            for (auto child: dynamic_cast<ExpressionShift&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::add:
+            for (auto child: dynamic_cast<ExpressionAdd&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::mult:
+            for (auto child: dynamic_cast<ExpressionMult&>(exp).expressions) fn(child);
+            break;
+        case ExpClass::unary: {
+            auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+            if (exp_unary.exp_type == "unary_op") {
+                fn(exp_unary.unary_exp);
+            } else if (exp_unary.exp_type == "postfix") {
+                fn(exp_unary.postfix_exp);
+            }
+            break;
+        }
+        case ExpClass::postfix: {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+            if (exp_post.exp_type == "bracket_exp") {
+                fn(exp_post.bracket_exp);
+            } else if (exp_post.exp_type == "function_call") {
+                for (auto arg: exp_post.args) fn(arg);
+            }
+            break;
+        }
+    }
+}
+
+// the only child of exp if exp just passes a single subexpression through
+// (e.g. an ExpressionAdd with one operand, or a bracketed expression), otherwise null
+std::shared_ptr<Expression> singleton_child(Expression& exp) {
+    switch (exp.exp_class) {
+        case ExpClass::comma: {
+            auto& exp_comma = dynamic_cast<ExpressionComma&>(exp);
+            if (exp_comma.exp_type == "assignment" && exp_comma.expressions.size() == 1) {
+                return exp_comma.expressions.front();
+            }
+            return nullptr;
+        }
+        case ExpClass::assignment: {
+            auto& exp_assign = dynamic_cast<ExpressionAssignment&>(exp);
+            return exp_assign.exp_type == "conditional"? exp_assign.expression: nullptr;
+        }
+        case ExpClass::conditional: {
+            auto& exp_cond = dynamic_cast<ExpressionConditional&>(exp);
+            return exp_cond.exp_type == "logic_or"? exp_cond.condition: nullptr;
+        }
+        case ExpClass::unary: {
+            auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+            return exp_unary.exp_type == "postfix"? exp_unary.postfix_exp: nullptr;
+        }
+        case ExpClass::postfix: {
+            auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+            return exp_post.exp_type == "bracket_exp"? exp_post.bracket_exp: nullptr;
+        }
+        default: {
+            std::shared_ptr<Expression> only_child;
+            int children = 0;
+            for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+                only_child = child;
+                children++;
+            });
+            return children == 1? only_child: nullptr;
+        }
+    }
+}
+
+// the first node under exp that is not a single-operand wrapper
+std::shared_ptr<Expression> innermost_expression(std::shared_ptr<Expression> exp) {
+    while (auto child = singleton_child(*exp)) {
+        exp = child;
+    }
+    return exp;
+}
+
+// evaluates exp if it is an integer literal, possibly bracketed or under unary operators
+bool constant_value(Expression& exp, int& value) {
+    if (auto child = singleton_child(exp)) {
+        return constant_value(*child, value);
+    }
+    if (exp.exp_class == ExpClass::postfix) {
+        auto& exp_post = dynamic_cast<ExpressionPostfix&>(exp);
+        if (exp_post.exp_type == "const_int") {
+            value = exp_post.value_int;
+            return true;
+        }
+    } else if (exp.exp_class == ExpClass::unary) {
+        auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+        if (exp_unary.exp_type == "unary_op" && constant_value(*exp_unary.unary_exp, value)) {
+            if (exp_unary.unaryop == "-") {
+                value = (int) (0u - (unsigned int) value);
+            } else if (exp_unary.unaryop == "~") {
+                value = ~value;
+            } else { // if (exp_unary.unaryop == "!") {
+                value = !value;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether evaluating exp assigns to, increments or decrements a variable
+// (the only side effects a called function cannot have on its caller's locals)
+bool writes_variables(Expression& exp) {
+    if (exp.exp_class == ExpClass::assignment) {
+        if (dynamic_cast<ExpressionAssignment&>(exp).exp_type == "assignment") {
+            return true;
+        }
+    } else if (exp.exp_class == ExpClass::unary) {
+        auto& exp_unary = dynamic_cast<ExpressionUnary&>(exp);
+        if (exp_unary.exp_type == "prefix") {
+            return true;
+        }
+    } else if (exp.exp_class == ExpClass::postfix) {
+        if (dynamic_cast<ExpressionPostfix&>(exp).exp_type == "postfix") {
+            return true;
+        }
+    }
+    bool writes = false;
+    for_each_child_expression(exp, [&](std::shared_ptr<Expression> child) {
+        writes = writes || writes_variables(*child);
+    });
+    return writes;
+}
+
 #define PARSER
 #endif
\ No newline at end of file
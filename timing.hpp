@@ -0,0 +1,336 @@
+#ifndef TIMING
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <boost/format.hpp>
+#include "json.hpp"
+
+// allocation counters, updated by the replacement global operator new below
+unsigned long long global_allocation_count = 0;
+unsigned long long global_allocation_bytes = 0;
+
+void* operator new(std::size_t size) {
+    global_allocation_count++;
+    global_allocation_bytes += size;
+    if (void* ptr = std::malloc(size? size: 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+class PhaseTiming {
+    public:
+    std::string name;
+    double wall_ms;
+    double cpu_ms;
+    long peak_rss_delta_kb;
+    unsigned long long allocations;
+    unsigned long long allocated_bytes;
+};
+
+std::vector<PhaseTiming> phase_timings;     // completed phases, in the order they finished
+std::vector<PhaseTiming> pass_timings;      // optimiser passes (part of the optimise phase), one per run
+
+class TraceEvent {
+    public:
+    std::string name;
+    std::string category;
+    double start_us;
+    double duration_us;
+    int thread_id;
+};
+
+bool trace_enabled = false;                 // set by --trace, events are only recorded when true
+std::vector<TraceEvent> trace_events;
+std::mutex trace_mutex;
+std::map<std::thread::id, int> trace_thread_ids;
+auto trace_epoch = std::chrono::steady_clock::now();
+
+double trace_time_us(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - trace_epoch).count();
+}
+
+void trace_record(std::string name, std::string category,
+                  std::chrono::steady_clock::time_point start,
+                  std::chrono::steady_clock::time_point end) {
+    if (!trace_enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(trace_mutex);
+
+    // map thread ids to small integers so the trace viewer shows readable rows
+    auto thread = std::this_thread::get_id();
+    if (!trace_thread_ids.count(thread)) {
+        int next_id = trace_thread_ids.size() + 1;
+        trace_thread_ids[thread] = next_id;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.start_us = trace_time_us(start);
+    event.duration_us = trace_time_us(end) - event.start_us;
+    event.thread_id = trace_thread_ids[thread];
+    trace_events.push_back(event);
+}
+
+// records a trace event spanning the lifetime of the scope
+class TraceScope {
+    public:
+    TraceScope(std::string event_name, std::string event_category) {
+        name = event_name;
+        category = event_category;
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~TraceScope() {
+        trace_record(name, category, start, std::chrono::steady_clock::now());
+    }
+
+    // events for work whose subject is only known once it is done (e.g. a function's name)
+    void rename(std::string event_name) {
+        name = event_name;
+    }
+
+    private:
+    std::string name;
+    std::string category;
+    std::chrono::steady_clock::time_point start;
+};
+
+// writes all recorded events in the Chrome trace-event format (loadable in chrome://tracing and Perfetto)
+void write_trace(std::string path) {
+    nlohmann::json trace;
+    trace["displayTimeUnit"] = "ms";
+    trace["traceEvents"] = nlohmann::json::array();
+    trace["traceEvents"] += {
+        {"name", "process_name"}, {"ph", "M"}, {"pid", 1}, {"tid", 0},
+        {"args", {{"name", "vcc"}}}
+    };
+    for (auto thread: trace_thread_ids) {
+        trace["traceEvents"] += {
+            {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", thread.second},
+            {"args", {{"name", thread.second == 1? "main": "worker " + std::to_string(thread.second)}}}
+        };
+    }
+    for (auto event: trace_events) {
+        trace["traceEvents"] += {
+            {"name", event.name},
+            {"cat", event.category},
+            {"ph", "X"},
+            {"ts", event.start_us},
+            {"dur", event.duration_us},
+            {"pid", 1},
+            {"tid", event.thread_id}
+        };
+    }
+
+    std::ofstream trace_file(path);
+    if (!trace_file) {
+        throw std::runtime_error("could not open trace file: " + path + "\n");
+    }
+    trace_file << trace.dump() << "\n";
+}
+
+// CPU time (user + system) of this process and any children it has waited for
+double cpu_time_ms() {
+#ifndef _WIN32
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    double seconds = self.ru_utime.tv_sec + self.ru_stime.tv_sec +
+                     children.ru_utime.tv_sec + children.ru_stime.tv_sec;
+    double micros = self.ru_utime.tv_usec + self.ru_stime.tv_usec +
+                    children.ru_utime.tv_usec + children.ru_stime.tv_usec;
+    return 1000.0*seconds + micros/1000.0;
+#else
+    return 1000.0*std::clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+// peak resident set size of this process in kilobytes (0 where unsupported)
+long peak_rss_kb() {
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+// measures one compiler phase from construction until stop() (or destruction), adding it to
+// timings and to the trace under category
+class PhaseTimer {
+    public:
+    PhaseTimer(std::string phase_name, std::vector<PhaseTiming>& timings = phase_timings, std::string category = "phase"):
+        timings(timings), category(category) {
+        name = phase_name;
+        start_wall = std::chrono::steady_clock::now();
+        start_cpu = cpu_time_ms();
+        start_rss = peak_rss_kb();
+        start_allocations = global_allocation_count;
+        start_bytes = global_allocation_bytes;
+    }
+
+    ~PhaseTimer() {
+        stop();
+    }
+
+    void stop() {
+        if (stopped) {
+            return;
+        }
+        stopped = true;
+
+        PhaseTiming timing;
+        timing.name = name;
+        timing.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_wall).count();
+        timing.cpu_ms = cpu_time_ms() - start_cpu;
+        timing.peak_rss_delta_kb = peak_rss_kb() - start_rss;
+        timing.allocations = global_allocation_count - start_allocations;
+        timing.allocated_bytes = global_allocation_bytes - start_bytes;
+        timings.push_back(timing);
+
+        trace_record(name, category, start_wall, std::chrono::steady_clock::now());
+    }
+
+    private:
+    std::vector<PhaseTiming>& timings;
+    std::string category;
+    std::string name;
+    bool stopped = false;
+    std::chrono::steady_clock::time_point start_wall;
+    double start_cpu;
+    long start_rss;
+    unsigned long long start_allocations;
+    unsigned long long start_bytes;
+};
+
+// timings added up by name, in the order each name first appears
+std::vector<PhaseTiming> timings_by_name(std::vector<PhaseTiming>& timings) {
+    std::vector<PhaseTiming> totals;
+    std::map<std::string, int> index;
+    for (auto timing: timings) {
+        if (!index.count(timing.name)) {
+            index[timing.name] = totals.size();
+            totals.push_back(timing);
+            continue;
+        }
+        auto& total = totals[index[timing.name]];
+        total.wall_ms += timing.wall_ms;
+        total.cpu_ms += timing.cpu_ms;
+        total.peak_rss_delta_kb += timing.peak_rss_delta_kb;
+        total.allocations += timing.allocations;
+        total.allocated_bytes += timing.allocated_bytes;
+    }
+    return totals;
+}
+
+std::string time_report_text() {
+    double total_wall = 0, total_cpu = 0;
+    for (auto timing: phase_timings) {
+        total_wall += timing.wall_ms;
+        total_cpu += timing.cpu_ms;
+    }
+
+    std::string out = "Execution times (milliseconds)\n";
+    out += (boost::format("  %-20s %10s %6s %10s %10s %12s %14s\n")
+            % "phase" % "wall" % "%" % "cpu" % "rss(kB)" % "allocs" % "bytes").str();
+    for (auto timing: phase_timings) {
+        out += (boost::format("  %-20s %10.3f %5.1f%% %10.3f %10d %12d %14d\n")
+                % timing.name
+                % timing.wall_ms
+                % (total_wall > 0? 100.0*timing.wall_ms/total_wall: 0.0)
+                % timing.cpu_ms
+                % timing.peak_rss_delta_kb
+                % timing.allocations
+                % timing.allocated_bytes).str();
+    }
+    out += (boost::format("  %-20s %10.3f %6s %10.3f %10d\n")
+            % "TOTAL" % total_wall % "" % total_cpu % peak_rss_kb()).str();
+
+    if (!pass_timings.empty()) {
+        double optimise_wall = 0;       // the passes' percentages are of the optimise phase
+        for (auto timing: phase_timings) {
+            if (timing.name == "optimise") optimise_wall += timing.wall_ms;
+        }
+        out += "\nOptimiser passes (milliseconds, within optimise)\n";
+        out += (boost::format("  %-20s %10s %6s %10s %10s %12s %14s\n")
+                % "pass" % "wall" % "%" % "cpu" % "rss(kB)" % "allocs" % "bytes").str();
+        for (auto timing: timings_by_name(pass_timings)) {
+            out += (boost::format("  %-20s %10.3f %5.1f%% %10.3f %10d %12d %14d\n")
+                    % timing.name
+                    % timing.wall_ms
+                    % (optimise_wall > 0? 100.0*timing.wall_ms/optimise_wall: 0.0)
+                    % timing.cpu_ms
+                    % timing.peak_rss_delta_kb
+                    % timing.allocations
+                    % timing.allocated_bytes).str();
+        }
+    }
+    return out;
+}
+
+std::string time_report_json() {
+    nlohmann::json report;
+    report["peak_rss_kb"] = peak_rss_kb();
+    report["phases"] = nlohmann::json::array();
+    for (auto timing: phase_timings) {
+        report["phases"] += {
+            {"name", timing.name},
+            {"wall_ms", timing.wall_ms},
+            {"cpu_ms", timing.cpu_ms},
+            {"peak_rss_delta_kb", timing.peak_rss_delta_kb},
+            {"allocations", timing.allocations},
+            {"allocated_bytes", timing.allocated_bytes}
+        };
+    }
+    report["passes"] = nlohmann::json::array();
+    for (auto timing: timings_by_name(pass_timings)) {
+        report["passes"] += {
+            {"name", timing.name},
+            {"wall_ms", timing.wall_ms},
+            {"cpu_ms", timing.cpu_ms},
+            {"peak_rss_delta_kb", timing.peak_rss_delta_kb},
+            {"allocations", timing.allocations},
+            {"allocated_bytes", timing.allocated_bytes}
+        };
+    }
+    return report.dump(4) + "\n";
+}
+
+#define TIMING
+#endif